@@ -56,7 +56,7 @@ struct BigInt {
       uint64_t a = limbs[i];
       uint64_t b = i < rhs.limbs.size() ? rhs.limbs[i] : 0;
       uint64_t sub = a - b - borrow;
-      borrow = (a < b + borrow);
+      borrow = (a < b) || (a - b < borrow); // b + borrow có thể tràn khi b = 2^64 - 1
       result.limbs[i] = sub;
     }
     while (!result.limbs.empty() && result.limbs.back() == 0)
@@ -257,6 +257,62 @@ struct MontgomeryContext {
   size_t k;
 };
 
+// Một hàng CIOS: dst[j] = src[j] + x * y[j] (j < k), trả về limb nhớ cuối.
+// dst được phép lùi một limb so với src (dst = src - 1) để gộp phép dịch của bước rút gọn.
+typedef uint64_t (*MacRowFn)(uint64_t *dst, const uint64_t *src, const uint64_t *y, uint64_t x, size_t k);
+
+uint64_t mac_row_portable(uint64_t *dst, const uint64_t *src, const uint64_t *y, uint64_t x, size_t k) {
+  uint64_t carry = 0;
+  for (size_t j = 0; j < k; ++j) {
+    __uint128_t cur = (__uint128_t)x * y[j] + src[j] + carry;
+    dst[j] = (uint64_t)cur;
+    carry = (uint64_t)(cur >> 64);
+  }
+  return carry;
+}
+
+#if defined(__x86_64__)
+// MULX + hai chuỗi nhớ độc lập: ADOX cộng nửa cao của tích trước (OF), ADCX cộng src[j] (CF).
+// Vòng lặp dùng lea/jrcxz để không đụng tới cờ. Chỉ có ở đây (limb 64 bit): các engine Montgomery của bai3
+// dùng limb 32 bit, nhớ nằm trong tích 64 bit chứ không trong cờ nên không có chuỗi ADC để tách.
+uint64_t mac_row_adx(uint64_t *dst, const uint64_t *src, const uint64_t *y, uint64_t x, size_t k) {
+  uint64_t hi, lo, h;
+  __asm__ volatile(
+      "xor %[hi], %[hi]\n\t"  // hi = 0, xóa CF và OF
+      "1:\n\t"
+      "jrcxz 2f\n\t"
+      "mulx (%[y]), %[lo], %[h]\n\t"
+      "adox %[hi], %[lo]\n\t"
+      "adcx (%[src]), %[lo]\n\t"
+      "mov %[lo], (%[dst])\n\t"
+      "mov %[h], %[hi]\n\t"
+      "lea 8(%[y]), %[y]\n\t"
+      "lea 8(%[src]), %[src]\n\t"
+      "lea 8(%[dst]), %[dst]\n\t"
+      "lea -1(%%rcx), %%rcx\n\t"
+      "jmp 1b\n\t"
+      "2:\n\t"
+      "mov $0, %[lo]\n\t"
+      "adox %[lo], %[hi]\n\t"
+      "adcx %[lo], %[hi]\n\t"
+      : [hi] "=&r"(hi), [lo] "=&r"(lo), [h] "=&r"(h), [dst] "+r"(dst), [src] "+r"(src), [y] "+r"(y), "+c"(k)
+      : "d"(x)
+      : "cc", "memory");
+  return hi;
+}
+#endif
+
+// chọn một lần lúc khởi động theo CPUID
+MacRowFn pick_mac_row() {
+#if defined(__x86_64__)
+  if (__builtin_cpu_supports("bmi2") && __builtin_cpu_supports("adx"))
+    return mac_row_adx;
+#endif
+  return mac_row_portable;
+}
+
+MacRowFn g_mac_row = pick_mac_row();
+
 MontgomeryContext montgomery_prepare(const BigInt &mod) {
   MontgomeryContext ctx;
   ctx.n = mod;
@@ -265,75 +321,84 @@ MontgomeryContext montgomery_prepare(const BigInt &mod) {
   return ctx;
 }
 
-BigInt montgomery_mul(const BigInt &a, const BigInt &b, const MontgomeryContext &ctx) {
-  size_t k = ctx.k;
-  const auto &n = ctx.n.limbs;
-
-  BigInt aa = a, bb = b;
-  while (aa >= ctx.n) aa = aa - ctx.n;
-  while (bb >= ctx.n) bb = bb - ctx.n;
-  if (aa.limbs.size() < k) aa.limbs.resize(k, 0);
-  if (bb.limbs.size() < k) bb.limbs.resize(k, 0);
-
+// Almost Montgomery: kết quả trung gian chỉ cần < R, bỏ phép so sánh đủ k limb ở mỗi lần nhân;
+// mod_pow_montgomery rút gọn về [0, n) một lần khi ra khỏi miền Montgomery.
+bool g_lazy_reduction = true;
 
-  BigInt t;
-  t.limbs.assign(k * 2 + 3, 0);
+// t >= n trên k limb thấp
+bool geq_limbs(const uint64_t *t, const uint64_t *n, size_t k) {
+  for (size_t i = k; i-- > 0;)
+    if (t[i] != n[i]) return t[i] > n[i];
+  return true;
+}
 
-  // multiply a * b
+// res = a * b * R^-1 mod n trên mảng đúng k limb, res được phép trùng a hoặc b.
+// a, b phải đã rút gọn: < R ở chế độ lazy, < n ở chế độ thường (không sao chép, không rút gọn lại ở đây).
+// buf là bộ đệm k + 3 limb của caller, dùng lại qua mọi lần nhân.
+void montgomery_mul(uint64_t *res, const uint64_t *a, const uint64_t *b, const MontgomeryContext &ctx,
+                    uint64_t *buf) {
+  size_t k = ctx.k;
+  const uint64_t *n = ctx.n.limbs.data();
 
+  // CIOS: mỗi vòng ngoài nhân một limb của a rồi rút gọn ngay, t chỉ cần k + 2 limb.
+  // buf[0] là chỗ trống để hàng rút gọn ghi lùi một limb (t[j - 1] = t[j] + m * n[j]).
+  std::fill(buf, buf + k + 3, 0);
+  uint64_t *t = buf + 1;
   for (size_t i = 0; i < k; ++i) {
-    __uint128_t carry = 0;
-    for (size_t j = 0; j < k; ++j) {
-      __uint128_t cur = (__uint128_t)aa.limbs[i] * bb.limbs[j] + t.limbs[i + j] + carry;
-      t.limbs[i + j] = (uint64_t)cur;
-      carry = cur >> 64;
-    }
-    t.limbs[i + k] += (uint64_t)carry;
+    uint64_t c = g_mac_row(t, t, b, a[i], k);
+    t[k] += c;
+    t[k + 1] += (t[k] < c);
+
+    uint64_t m = t[0] * ctx.n_inv;
+    c = g_mac_row(t - 1, t, n, m, k);
+    uint64_t top = t[k] + c;
+    t[k - 1] = top;
+    t[k] = t[k + 1] + (top < c);
+    t[k + 1] = 0;
   }
 
-  //montgomery reducction
-  for (size_t i = 0; i < k; ++i){
-    uint64_t m = (uint64_t) ((__uint128_t)t.limbs[i] * ctx.n_inv);
-    __uint128_t carry = 0;
+  // t < R + n: lazy chỉ trừ khi tràn sang t[k] (kết quả < R), chế độ thường trừ khi >= n
+  if (t[k] || (!g_lazy_reduction && geq_limbs(t, n, k))) {
+    uint64_t borrow = 0;
     for (size_t j = 0; j < k; ++j) {
-      __uint128_t cur = (__uint128_t)m * n[j] + t.limbs[i + j] + carry;
-      t.limbs[i + j] = (uint64_t)cur;
-      carry = cur >> 64;
+      uint64_t d = t[j] - n[j] - borrow;
+      borrow = (t[j] < n[j]) || (t[j] - n[j] < borrow);
+      t[j] = d;
     }
-    size_t pos = i + k;
-    __uint128_t cur = (__uint128_t)t.limbs[pos] + carry;
-    t.limbs[pos] = (uint64_t)cur;
-    carry = cur >> 64;
-    if (carry && pos + 1 < t.limbs.size())
-      t.limbs[pos + 1] += (uint64_t)carry;
   }
-
-  BigInt res;
-  res.limbs.assign(t.limbs.begin() + k, t.limbs.begin() + 2 * k);
-  res.normalize();
-
-  if (res >= ctx.n)
-    res = res - ctx.n;
-
-  return res;
+  std::copy(t, t + k, res);
 }
 
+// BigInt -> đúng k limb (v < R)
+std::vector<uint64_t> to_limbs(const BigInt &v, size_t k) {
+  std::vector<uint64_t> r(v.limbs.begin(), v.limbs.end());
+  r.resize(k, 0);
+  return r;
+}
 
 BigInt mod_pow_montgomery(BigInt base, BigInt exp, const BigInt &mod) {
   MontgomeryContext ctx = montgomery_prepare(mod);
-  BigInt R2 = compute_R2_mod(mod);
-  BigInt baseM = montgomery_mul(base % mod, R2, ctx);
-  BigInt resultM = montgomery_mul(BigInt::one(), R2, ctx);
+  size_t k = ctx.k;
+  std::vector<uint64_t> R2 = to_limbs(compute_R2_mod(mod), k);
+  std::vector<uint64_t> baseM = to_limbs(base % mod, k), resultM(k, 0), one(k, 0), buf(k + 3);
+  one[0] = 1;
+  montgomery_mul(baseM.data(), baseM.data(), R2.data(), ctx, buf.data());
+  montgomery_mul(resultM.data(), one.data(), R2.data(), ctx, buf.data());
 
   while (!exp.is_zero()) {
     if (!exp.is_even())
-      resultM = montgomery_mul(resultM, baseM, ctx);
+      montgomery_mul(resultM.data(), resultM.data(), baseM.data(), ctx, buf.data());
     exp = exp >> 1;
-    baseM = montgomery_mul(baseM, baseM, ctx);
+    montgomery_mul(baseM.data(), baseM.data(), baseM.data(), ctx, buf.data());
   }
 
-  //convert back
-  BigInt res = montgomery_mul(resultM, BigInt::one(), ctx);
+  //convert back (resultM < R nên res <= n)
+  montgomery_mul(resultM.data(), resultM.data(), one.data(), ctx, buf.data());
+  BigInt res;
+  res.limbs = resultM;
+  res.normalize();
+  if (res >= mod)
+    res = res - mod;
   return res;
 }
 
@@ -3,6 +3,10 @@
 #include <string>
 #include <fstream>
 #include <chrono> 
+#include <map>
+#include <algorithm>
+#include <thread>
+#include <atomic>
 
 using namespace std;
 
@@ -31,8 +35,15 @@ class BigInt {
         bool operator!=(const BigInt& other) const;
         bool operator==(const BigInt& other) const;
 
+        static BigInt fromWord(uint64_t v);
+        bool toWord(uint64_t& v) const;
+        size_t bitLength() const;
+        BigInt divModWord(uint64_t divisor, uint64_t& rem) const;
+
         static GcdResult extendedEuclidean(BigInt a, BigInt b);
+        static uint64_t wordInverse(uint64_t a, uint64_t m);
         static BigInt modInverse(BigInt e, BigInt phi);
+        static vector<BigInt> batchModInverse(const vector<BigInt>& values, const BigInt& phi);
         string toHexReverse();
 };
 
@@ -401,6 +412,60 @@ bool BigInt::operator>(const BigInt& other) const {
     return !this->isMagnitudeLessThan(other) && (*this != other);
 }
 
+BigInt BigInt::fromWord(uint64_t v) {
+    BigInt result;
+    result.bin.clear();
+    for (int i = 63; i >= 0; i--) {
+        result.bin.push_back((v >> i) & 1);
+    }
+    result.removeLeadingZeros();
+    return result;
+}
+
+// true nếu |this| vừa một word 64-bit
+bool BigInt::toWord(uint64_t& v) const {
+    if (bin.size() > 64) {
+        return false;
+    }
+    v = 0;
+    for (size_t i = 0; i < bin.size(); i++) {
+        v = (v << 1) | (uint64_t)bin[i];
+    }
+    return true;
+}
+
+// toHexReverse() có thể chèn thêm bit 0 ở đầu nên phải bỏ qua chúng
+size_t BigInt::bitLength() const {
+    size_t i = 0;
+    while (i < bin.size() && !bin[i]) {
+        i++;
+    }
+    return bin.size() - i;
+}
+
+// Chia |this| cho một word, trả về thương, phần dư ghi vào rem
+BigInt BigInt::divModWord(uint64_t divisor, uint64_t& rem) const {
+    if (divisor == 0) {
+        throw std::runtime_error("Division by zero");
+    }
+
+    BigInt quotient;
+    quotient.bin.assign(bin.size(), 0);
+    unsigned __int128 r = 0;
+
+    for (size_t i = 0; i < bin.size(); i++) {
+        r = (r << 1) | (unsigned __int128)bin[i];
+        if (r >= divisor) {
+            r -= divisor;
+            quotient.bin[i] = 1;
+        }
+    }
+
+    rem = (uint64_t)r;
+    quotient.removeLeadingZeros();
+    return quotient;
+}
+
 GcdResult BigInt::extendedEuclidean(BigInt a, BigInt b) {
     BigInt x0("1"), x1("0");
     BigInt y0("0"), y1("1");
@@ -428,12 +493,56 @@ GcdResult BigInt::extendedEuclidean(BigInt a, BigInt b) {
     return {a, x0, y0}; 
 }
 
+// a^(-1) mod m trên word, trả về 0 nếu không tồn tại (m > 1)
+uint64_t BigInt::wordInverse(uint64_t a, uint64_t m) {
+    __int128 t0 = 0, t1 = 1;
+    uint64_t r0 = m, r1 = a % m;
+
+    while (r1 != 0) {
+        uint64_t q = r0 / r1;
+
+        uint64_t tempR = r1;
+        r1 = r0 - q * r1;
+        r0 = tempR;
+
+        __int128 tempT = t1;
+        t1 = t0 - (__int128)q * t1;
+        t0 = tempT;
+    }
+
+    if (r0 != 1) {
+        return 0;
+    }
+    if (t0 < 0) {
+        t0 += m;
+    }
+    return (uint64_t)t0;
+}
+
 BigInt BigInt::modInverse(BigInt e, BigInt phi) {
-    GcdResult res = extendedEuclidean(e, phi);
-    
     BigInt one("1");
     BigInt negOne("-1");
 
+    // Fast path: e vừa một word (3, 17, 65537, ...).
+    // Tìm k sao cho k * phi = -1 (mod e), khi đó d = (1 + k * phi) / e chia hết và d < phi.
+    uint64_t eWord;
+    if (e.toWord(eWord) && eWord > 1) {
+        uint64_t phiModE;
+        phi.divModWord(eWord, phiModE);
+
+        uint64_t inv = wordInverse(phiModE, eWord);
+        if (inv == 0) {
+            return negOne;
+        }
+        uint64_t k = eWord - inv;
+
+        uint64_t rem;
+        BigInt d = (fromWord(k) * phi + one).divModWord(eWord, rem);
+        return d;
+    }
+
+    GcdResult res = extendedEuclidean(e, phi);
+
     if (res.gcd != one) {
         return negOne; 
     }
@@ -445,7 +554,187 @@ BigInt BigInt::modInverse(BigInt e, BigInt phi) {
     return d;
 }
 
+// Montgomery's trick: n nghịch đảo cùng modulo phi = 1 lần nghịch đảo + 3(n-1) phép nhân
+vector<BigInt> BigInt::batchModInverse(const vector<BigInt>& values, const BigInt& phi) {
+    BigInt one("1");
+    size_t n = values.size();
+    vector<BigInt> result(n);
+    if (n == 0) {
+        return result;
+    }
+
+    // prefix[i] = values[0] * ... * values[i] mod phi
+    vector<BigInt> prefix(n);
+    prefix[0] = values[0] % phi;
+    for (size_t i = 1; i < n; i++) {
+        prefix[i] = (prefix[i - 1] * values[i]) % phi;
+    }
+
+    GcdResult res = extendedEuclidean(prefix[n - 1], phi);
+    if (res.gcd != one) {
+        // Có phần tử không khả nghịch -> tính riêng từng phần tử
+        for (size_t i = 0; i < n; i++) {
+            result[i] = modInverse(values[i], phi);
+        }
+        return result;
+    }
+
+    BigInt inv = (res.x % phi + phi) % phi;
+    for (size_t i = n - 1; i > 0; i--) {
+        result[i] = (inv * prefix[i - 1]) % phi;
+        inv = (inv * values[i]) % phi;
+    }
+    result[0] = inv;
+    return result;
+}
+
+struct KeyJob {
+    string p_hex, q_hex, e_hex;
+    string d_hex;
+};
+
+// Batch mode: mỗi bộ 3 dòng (p, q, e), kết quả ghi theo đúng thứ tự đầu vào
+int runBatch(const string& inPath, const string& outPath, unsigned threads) {
+    ifstream in(inPath);
+    ofstream out(outPath);
+
+    if (!in.is_open() || !out.is_open()) {
+        cerr << "Error opening file(s)" << endl;
+        return 1;
+    }
+
+    vector<KeyJob> jobs;
+    string line;
+    vector<string> fields;
+    size_t lineNo = 0, fieldLine = 0;
+    while (getline(in, line)) {
+        lineNo++;
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (line.empty()) {
+            continue;
+        }
+        if (fields.empty()) {
+            fieldLine = lineNo;
+        }
+        fields.push_back(line);
+        if (fields.size() == 3) {
+            jobs.push_back({fields[0], fields[1], fields[2], "-1"});
+            fields.clear();
+        }
+    }
+    // Bộ cuối thiếu dòng: báo lỗi thay vì bỏ qua im lặng
+    if (!fields.empty()) {
+        cerr << "Malformed input: incomplete record at line " << fieldLine << " (" << fields.size()
+             << " of 3 lines: p, q, e)" << endl;
+        return 1;
+    }
+
+    auto start = chrono::high_resolution_clock::now();
+
+    // Gom các job có cùng phi (cùng cặp p, q)
+    map<pair<string, string>, vector<size_t>> groupMap;
+    for (size_t i = 0; i < jobs.size(); i++) {
+        pair<string, string> key = minmax(jobs[i].p_hex, jobs[i].q_hex);
+        groupMap[key].push_back(i);
+    }
+    vector<vector<size_t>> groups;
+    for (auto& g : groupMap) {
+        groups.push_back(g.second);
+    }
+
+    atomic<size_t> nextGroup(0);
+    atomic<size_t> batchedCount(0);
+
+    auto worker = [&]() {
+        BigInt one("1");
+        BigInt negOne("-1");
+        size_t g;
+        while ((g = nextGroup.fetch_add(1)) < groups.size()) {
+            const vector<size_t>& idx = groups[g];
+            try {
+                BigInt p(jobs[idx[0]].p_hex);
+                BigInt q(jobs[idx[0]].q_hex);
+                BigInt phi = (p - one) * (q - one);
+
+                // e vừa một word đã có fast path riêng, rẻ hơn một phép nhân mod phi
+                vector<size_t> wide;
+                vector<BigInt> wideValues;
+                for (size_t i : idx) {
+                    BigInt e(jobs[i].e_hex);
+                    uint64_t eWord;
+                    if (e.toWord(eWord)) {
+                        BigInt d = BigInt::modInverse(e, phi);
+                        jobs[i].d_hex = (d == negOne) ? "-1" : d.toHexReverse();
+                    } else {
+                        wide.push_back(i);
+                        wideValues.push_back(e);
+                    }
+                }
+
+                vector<BigInt> ds = BigInt::batchModInverse(wideValues, phi);
+                for (size_t j = 0; j < wide.size(); j++) {
+                    jobs[wide[j]].d_hex = (ds[j] == negOne) ? "-1" : ds[j].toHexReverse();
+                }
+                batchedCount += wide.size();
+            } catch (const exception& ex) {
+                cerr << "An error occurred: " << ex.what() << endl;
+            }
+        }
+    };
+
+    if (threads == 0) {
+        threads = 1;
+    }
+    vector<thread> pool;
+    for (unsigned t = 1; t < threads; t++) {
+        pool.emplace_back(worker);
+    }
+    worker();
+    for (auto& th : pool) {
+        th.join();
+    }
+
+    auto end = chrono::high_resolution_clock::now();
+    chrono::duration<double, milli> duration = end - start;
+
+    for (const KeyJob& job : jobs) {
+        out << job.d_hex << endl;
+    }
+
+    double seconds = duration.count() / 1000.0;
+    cout << "Keys: " << jobs.size() << ", groups: " << groups.size()
+         << ", batched inversions: " << batchedCount.load() << ", threads: " << threads << endl;
+    cout << "Time: " << duration.count() << "ms";
+    if (seconds > 0) {
+        cout << " (" << jobs.size() / seconds << " keys/s)";
+    }
+    cout << endl;
+
+    in.close();
+    out.close();
+    return 0;
+}
+
 int main(int argc, char *argv[]) {
+    if (argc >= 4 && string(argv[1]) == "--batch") {
+        unsigned threads = (argc >= 5) ? stoul(argv[4]) : thread::hardware_concurrency();
+        return runBatch(argv[2], argv[3], threads);
+    }
+
+    // Tuỳ chọn: --crt ghi thêm dP, dQ, qInv (mỗi giá trị một dòng) sau d
+    // --lambda tính d theo lambda(n) = lcm(p-1, q-1) thay vì phi
+    bool emitCrt = false;
+    bool useLambda = false;
+    for (int i = 3; i < argc; i++) {
+        if (string(argv[i]) == "--crt") {
+            emitCrt = true;
+        } else if (string(argv[i]) == "--lambda") {
+            useLambda = true;
+        }
+    }
+
     ifstream in(argv[1]);
     ofstream out(argv[2]);
 
@@ -472,7 +761,13 @@ int main(int argc, char *argv[]) {
         BigInt q_minus_1 = q - one;
         BigInt phi = p_minus_1 * q_minus_1;
 
-        // 2. Tính d = e^(-1) mod phi
+        // lambda = (p-1) / gcd(p-1, q-1) * (q-1)
+        if (useLambda) {
+            BigInt g = BigInt::extendedEuclidean(p_minus_1, q_minus_1).gcd;
+            phi = (p_minus_1 / g) * q_minus_1;
+        }
+
+        // 2. Tính d = e^(-1) mod phi (hoặc lambda)
         BigInt d = BigInt::modInverse(e, phi);
 
         // 3. Kiểm tra và ghi kết quả
@@ -481,6 +776,25 @@ int main(int argc, char *argv[]) {
         } else {
             string d_hex = d.toHexReverse();
             out << d_hex << endl;
+
+            if (useLambda) {
+                cout << "d bits: " << d.bitLength() << endl;
+            }
+
+            // 4. Tham số CRT: dP = d mod (p-1), dQ = d mod (q-1), qInv = q^(-1) mod p
+            if (emitCrt) {
+                BigInt dP = d % p_minus_1;
+                BigInt dQ = d % q_minus_1;
+                BigInt qInv = BigInt::modInverse(q, p);
+
+                out << dP.toHexReverse() << endl;
+                out << dQ.toHexReverse() << endl;
+                if (qInv == negOne) {
+                    out << -1 << endl;
+                } else {
+                    out << qInv.toHexReverse() << endl;
+                }
+            }
         }
 
     } catch (const exception& ex) {
@@ -0,0 +1,610 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <exception>
+#include <system_error>
+#include <functional>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+// Batch GCD (Bernstein): tìm các modulus có chung thừa số nguyên tố trong cả một tập khoá.
+//   1. product tree: P = N_1 * N_2 * ... * N_k
+//   2. remainder tree: đi xuống từ gốc, tại mỗi nút lấy phần dư modulo (giá trị nút)^2
+//   3. ở lá: g_i = gcd(N_i, (P mod N_i^2) / N_i)
+
+struct BigInt {
+    static const uint64_t BASE = (1ULL << 32);
+    vector<uint32_t> a; // little-endian, a[0] là word thấp nhất; rỗng = 0
+
+    bool isZero() const { return a.empty(); }
+
+    void trim() {
+        while (!a.empty() && a.back() == 0) {
+            a.pop_back();
+        }
+    }
+
+    static BigInt fromHexReverse(const string& s);
+    string toHexReverse() const;
+
+    static int compare(const BigInt& A, const BigInt& B);
+    static BigInt add(const BigInt& A, const BigInt& B);
+    static BigInt subtract(const BigInt& A, const BigInt& B);
+    static BigInt shiftWords(const BigInt& A, size_t k);
+    static BigInt shiftRightWords(const BigInt& A, size_t k);
+    static BigInt multiply(const BigInt& A, const BigInt& B);
+    static void divideSchool(const BigInt& U, const BigInt& V, BigInt& Q, BigInt& R);
+    static BigInt reciprocal(const BigInt& V, size_t L);
+    static void divide(const BigInt& U, const BigInt& V, BigInt& Q, BigInt& R);
+    static BigInt gcd(BigInt A, BigInt B);
+};
+
+// Chuỗi hex đảo ngược: ký tự đầu tiên là nibble thấp nhất
+BigInt BigInt::fromHexReverse(const string& s) {
+    BigInt r;
+    r.a.assign((s.size() + 7) / 8, 0);
+    for (size_t i = 0; i < s.size(); i++) {
+        char c = s[i];
+        uint32_t v = (c >= '0' && c <= '9') ? c - '0' : (toupper(c) - 'A' + 10);
+        r.a[i / 8] |= (v & 0xF) << (4 * (i % 8));
+    }
+    r.trim();
+    return r;
+}
+
+string BigInt::toHexReverse() const {
+    if (isZero()) {
+        return "0";
+    }
+    const string hexChars = "0123456789ABCDEF";
+    string s;
+    for (size_t i = 0; i < a.size(); i++) {
+        for (int j = 0; j < 8; j++) {
+            s.push_back(hexChars[(a[i] >> (4 * j)) & 0xF]);
+        }
+    }
+    while (s.size() > 1 && s.back() == '0') {
+        s.pop_back();
+    }
+    return s;
+}
+
+int BigInt::compare(const BigInt& A, const BigInt& B) {
+    if (A.a.size() != B.a.size()) {
+        return (A.a.size() < B.a.size()) ? -1 : 1;
+    }
+    for (int i = (int)A.a.size() - 1; i >= 0; i--) {
+        if (A.a[i] != B.a[i]) {
+            return (A.a[i] < B.a[i]) ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+BigInt BigInt::add(const BigInt& A, const BigInt& B) {
+    const BigInt& L = (A.a.size() >= B.a.size()) ? A : B;
+    const BigInt& S = (A.a.size() >= B.a.size()) ? B : A;
+    BigInt C;
+    C.a.resize(L.a.size() + 1);
+    uint64_t carry = 0;
+    for (size_t i = 0; i < L.a.size(); i++) {
+        uint64_t sum = (uint64_t)L.a[i] + (i < S.a.size() ? S.a[i] : 0) + carry;
+        C.a[i] = (uint32_t)sum;
+        carry = sum >> 32;
+    }
+    C.a[L.a.size()] = (uint32_t)carry;
+    C.trim();
+    return C;
+}
+
+// A - B, yêu cầu A >= B
+BigInt BigInt::subtract(const BigInt& A, const BigInt& B) {
+    BigInt C = A;
+    uint64_t borrow = 0;
+    for (size_t i = 0; i < C.a.size() && (i < B.a.size() || borrow); i++) {
+        uint64_t sub = (uint64_t)(i < B.a.size() ? B.a[i] : 0) + borrow;
+        borrow = (C.a[i] < sub) ? 1 : 0;
+        C.a[i] = (uint32_t)(C.a[i] + BASE - sub);
+    }
+    C.trim();
+    return C;
+}
+
+BigInt BigInt::shiftWords(const BigInt& A, size_t k) {
+    if (A.isZero()) {
+        return A;
+    }
+    BigInt C;
+    C.a.assign(k, 0);
+    C.a.insert(C.a.end(), A.a.begin(), A.a.end());
+    return C;
+}
+
+BigInt BigInt::shiftRightWords(const BigInt& A, size_t k) {
+    BigInt C;
+    if (k < A.a.size()) {
+        C.a.assign(A.a.begin() + k, A.a.end());
+    }
+    return C;
+}
+
+static BigInt powerOfBase(size_t k) {
+    BigInt r;
+    r.a.assign(k + 1, 0);
+    r.a[k] = 1;
+    return r;
+}
+
+static const size_t KARATSUBA_THRESHOLD = 48;
+static const size_t NEWTON_THRESHOLD = 64;
+
+static void splitAt(const BigInt& A, size_t h, BigInt& lo, BigInt& hi) {
+    size_t cut = min(h, A.a.size());
+    lo.a.assign(A.a.begin(), A.a.begin() + cut);
+    hi.a.assign(A.a.begin() + cut, A.a.end());
+    lo.trim();
+    hi.trim();
+}
+
+// Karatsuba, dưới ngưỡng thì nhân trường học
+BigInt BigInt::multiply(const BigInt& A, const BigInt& B) {
+    if (A.isZero() || B.isZero()) {
+        return BigInt();
+    }
+
+    if (min(A.a.size(), B.a.size()) < KARATSUBA_THRESHOLD) {
+        BigInt C;
+        C.a.assign(A.a.size() + B.a.size(), 0);
+        for (size_t i = 0; i < A.a.size(); i++) {
+            uint64_t carry = 0;
+            for (size_t j = 0; j < B.a.size(); j++) {
+                uint64_t prod = (uint64_t)A.a[i] * B.a[j] + C.a[i + j] + carry;
+                C.a[i + j] = (uint32_t)prod;
+                carry = prod >> 32;
+            }
+            C.a[i + B.a.size()] = (uint32_t)carry;
+        }
+        C.trim();
+        return C;
+    }
+
+    size_t h = max(A.a.size(), B.a.size()) / 2;
+    BigInt a0, a1, b0, b1;
+    splitAt(A, h, a0, a1);
+    splitAt(B, h, b0, b1);
+
+    BigInt z0 = multiply(a0, b0);
+    BigInt z2 = multiply(a1, b1);
+    BigInt z1 = subtract(subtract(multiply(add(a0, a1), add(b0, b1)), z0), z2);
+
+    return add(add(shiftWords(z2, 2 * h), shiftWords(z1, h)), z0);
+}
+
+// Knuth Algorithm D: U = Q * V + R
+void BigInt::divideSchool(const BigInt& U, const BigInt& V, BigInt& Q, BigInt& R) {
+    if (V.isZero()) {
+        throw runtime_error("Division by zero");
+    }
+    if (compare(U, V) < 0) {
+        Q = BigInt();
+        R = U;
+        return;
+    }
+
+    size_t n = V.a.size();
+    size_t m = U.a.size();
+
+    if (n == 1) {
+        Q.a.assign(m, 0);
+        uint64_t rem = 0;
+        for (int i = (int)m - 1; i >= 0; i--) {
+            uint64_t cur = (rem << 32) | U.a[i];
+            Q.a[i] = (uint32_t)(cur / V.a[0]);
+            rem = cur % V.a[0];
+        }
+        Q.trim();
+        R.a.assign(1, (uint32_t)rem);
+        R.trim();
+        return;
+    }
+
+    // Chuẩn hoá: dịch trái để bit cao nhất của V bằng 1
+    int s = __builtin_clz(V.a[n - 1]);
+    vector<uint32_t> vn(n), un(m + 1);
+    for (size_t i = n - 1; i > 0; i--) {
+        vn[i] = (V.a[i] << s) | (s ? (uint32_t)((uint64_t)V.a[i - 1] >> (32 - s)) : 0);
+    }
+    vn[0] = V.a[0] << s;
+    un[m] = s ? (uint32_t)((uint64_t)U.a[m - 1] >> (32 - s)) : 0;
+    for (size_t i = m - 1; i > 0; i--) {
+        un[i] = (U.a[i] << s) | (s ? (uint32_t)((uint64_t)U.a[i - 1] >> (32 - s)) : 0);
+    }
+    un[0] = U.a[0] << s;
+
+    Q.a.assign(m - n + 1, 0);
+    for (int j = (int)(m - n); j >= 0; j--) {
+        // Ước lượng chữ số thương từ 2 word cao, sửa tối đa 2 lần
+        uint64_t num = ((uint64_t)un[j + n] << 32) | un[j + n - 1];
+        uint64_t qhat = num / vn[n - 1];
+        uint64_t rhat = num % vn[n - 1];
+        while (qhat >= BASE || qhat * vn[n - 2] > ((rhat << 32) | un[j + n - 2])) {
+            qhat--;
+            rhat += vn[n - 1];
+            if (rhat >= BASE) {
+                break;
+            }
+        }
+
+        // un[j..j+n] -= qhat * vn
+        int64_t borrow = 0;
+        uint64_t carry = 0;
+        for (size_t i = 0; i < n; i++) {
+            uint64_t p = qhat * vn[i] + carry;
+            carry = p >> 32;
+            int64_t t = (int64_t)un[i + j] - (int64_t)(uint32_t)p - borrow;
+            un[i + j] = (uint32_t)t;
+            borrow = (t < 0) ? 1 : 0;
+        }
+        int64_t t = (int64_t)un[j + n] - (int64_t)carry - borrow;
+        un[j + n] = (uint32_t)t;
+
+        // qhat lớn hơn 1: cộng trả lại V
+        if (t < 0) {
+            qhat--;
+            uint64_t c = 0;
+            for (size_t i = 0; i < n; i++) {
+                uint64_t sum = (uint64_t)un[i + j] + vn[i] + c;
+                un[i + j] = (uint32_t)sum;
+                c = sum >> 32;
+            }
+            un[j + n] += (uint32_t)c;
+        }
+        Q.a[j] = (uint32_t)qhat;
+    }
+    Q.trim();
+
+    R.a.assign(n, 0);
+    for (size_t i = 0; i < n; i++) {
+        R.a[i] = (un[i] >> s) | (s ? (uint32_t)((uint64_t)un[i + 1] << (32 - s)) : 0);
+    }
+    R.trim();
+}
+
+// Xấp xỉ floor(B^L / V) (sai số vài đơn vị) bằng Newton, mỗi bước gấp đôi số word chính xác
+BigInt BigInt::reciprocal(const BigInt& V, size_t L) {
+    size_t n = V.a.size();
+    size_t p = L - n;
+    if (min(p, n) <= NEWTON_THRESHOLD) {
+        BigInt Q, R;
+        divideSchool(powerOfBase(L), V, Q, R);
+        return Q;
+    }
+
+    // Nghịch đảo nửa độ chính xác từ các word cao của V
+    size_t h = p / 2 + 1;
+    size_t s = (n > h + 2) ? n - (h + 2) : 0;
+    BigInt Vt = shiftRightWords(V, s);
+    BigInt X = shiftWords(reciprocal(Vt, Vt.a.size() + h), p - h);
+
+    // X = X +- X * |B^L - V * X| / B^L; tích này chỉ cần ~h word nên bỏ bớt word thấp của X và E
+    size_t sx = h - 2;
+    size_t se = n - 2;
+    BigInt BL = powerOfBase(L);
+    BigInt T = multiply(V, X);
+    if (compare(T, BL) <= 0) {
+        BigInt E = subtract(BL, T);
+        X = add(X, shiftRightWords(multiply(shiftRightWords(X, sx), shiftRightWords(E, se)), L - sx - se));
+    } else {
+        BigInt E = subtract(T, BL);
+        BigInt D = shiftRightWords(multiply(shiftRightWords(X, sx), shiftRightWords(E, se)), L - sx - se);
+        X = (compare(X, D) > 0) ? subtract(X, D) : BigInt();
+    }
+    return X;
+}
+
+// Số lớn thì chia kiểu Barrett qua nghịch đảo để dùng được Karatsuba, số nhỏ dùng Algorithm D
+void BigInt::divide(const BigInt& U, const BigInt& V, BigInt& Q, BigInt& R) {
+    if (V.isZero()) {
+        throw runtime_error("Division by zero");
+    }
+    if (compare(U, V) < 0) {
+        Q = BigInt();
+        R = U;
+        return;
+    }
+
+    size_t n = V.a.size();
+    size_t m = U.a.size();
+    if (min(n, m - n) <= NEWTON_THRESHOLD) {
+        divideSchool(U, V, Q, R);
+        return;
+    }
+
+    // Q = floor(U / B^(n-1) * inv / B^(m-n+2)) chỉ lệch thương đúng vài đơn vị
+    BigInt inv = reciprocal(V, m + 1);
+    Q = shiftRightWords(multiply(shiftRightWords(U, n - 1), inv), m - n + 2);
+
+    BigInt one = powerOfBase(0);
+    BigInt T = multiply(Q, V);
+    while (compare(T, U) > 0) {
+        Q = subtract(Q, one);
+        T = subtract(T, V);
+    }
+    R = subtract(U, T);
+    while (compare(R, V) >= 0) {
+        R = subtract(R, V);
+        Q = add(Q, one);
+    }
+}
+
+BigInt BigInt::gcd(BigInt A, BigInt B) {
+    BigInt Q, R;
+    while (!B.isZero()) {
+        divide(A, B, Q, R);
+        A = B;
+        B = R;
+    }
+    return A;
+}
+
+// ---- Scratch file cho từng tầng của cây ----
+// Định dạng: [count][offset[0..count]][limbs...], offset tính theo số word
+static void writeLevel(const string& path, const vector<BigInt>& nodes) {
+    ofstream f(path, ios::binary);
+    if (!f.is_open()) {
+        throw runtime_error("Cannot create scratch file " + path);
+    }
+    uint64_t count = nodes.size();
+    f.write((const char*)&count, sizeof(count));
+    uint64_t offset = 0;
+    for (size_t i = 0; i <= nodes.size(); i++) {
+        f.write((const char*)&offset, sizeof(offset));
+        if (i < nodes.size()) {
+            offset += nodes[i].a.size();
+        }
+    }
+    for (const BigInt& node : nodes) {
+        f.write((const char*)node.a.data(), node.a.size() * sizeof(uint32_t));
+    }
+    if (!f) {
+        throw runtime_error("Cannot write scratch file " + path);
+    }
+}
+
+// Tên scratch file duy nhất cho mỗi lần chạy (mkstemp), nên nhiều tiến trình dùng chung scratch_dir được.
+// Destructor xóa mọi file đã tạo, kể cả khi thoát giữa chừng vì exception.
+struct ScratchFiles {
+    string dir;
+    vector<string> paths;
+
+    const string& create() {
+        string name = dir + "/batch_gcd_level_" + to_string(paths.size()) + "_XXXXXX";
+        vector<char> buf(name.begin(), name.end());
+        buf.push_back('\0');
+        int fd = mkstemp(buf.data());
+        if (fd < 0) {
+            throw runtime_error("Cannot create scratch file " + name);
+        }
+        ::close(fd);
+        paths.push_back(buf.data());
+        return paths.back();
+    }
+
+    ~ScratchFiles() {
+        for (const string& path : paths) {
+            remove(path.c_str());
+        }
+    }
+};
+
+struct MappedLevel {
+    void* base = MAP_FAILED;
+    size_t length = 0;
+    uint64_t count = 0;
+    const uint64_t* offsets = nullptr;
+    const uint32_t* limbs = nullptr;
+
+    void open(const string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw runtime_error("Cannot open scratch file " + path);
+        }
+        struct stat st;
+        fstat(fd, &st);
+        length = st.st_size;
+        base = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (base == MAP_FAILED) {
+            throw runtime_error("Cannot map scratch file " + path);
+        }
+        count = *(const uint64_t*)base;
+        offsets = (const uint64_t*)base + 1;
+        limbs = (const uint32_t*)(offsets + count + 1);
+    }
+
+    BigInt node(size_t i) const {
+        BigInt r;
+        r.a.assign(limbs + offsets[i], limbs + offsets[i + 1]);
+        return r;
+    }
+
+    void close() {
+        if (base != MAP_FAILED) {
+            munmap(base, length);
+            base = MAP_FAILED;
+        }
+    }
+
+    ~MappedLevel() { close(); }
+};
+
+// Lỗi trong body (vd. bad_alloc khi cây tích quá lớn) không được thoát khỏi thread (std::terminate):
+// giữ lỗi đầu tiên, các thread bỏ phần việc còn lại, join xong mới ném lại ở thread gọi.
+static void parallelFor(size_t count, unsigned threads, const function<void(size_t)>& body) {
+    atomic<size_t> next(0);
+    mutex errorLock;
+    exception_ptr error;
+    auto worker = [&]() {
+        size_t i;
+        while ((i = next.fetch_add(1)) < count) {
+            try {
+                body(i);
+            } catch (...) {
+                lock_guard<mutex> guard(errorLock);
+                if (!error) {
+                    error = current_exception();
+                }
+                next = count;
+            }
+        }
+    };
+
+    vector<thread> pool;
+    for (unsigned t = 1; t < threads && t < count; t++) {
+        try {
+            pool.emplace_back(worker);
+        } catch (const system_error&) {
+            break; // không tạo thêm được thread: các thread đã có làm nốt
+        }
+    }
+    worker();
+    for (auto& th : pool) {
+        th.join();
+    }
+    if (error) {
+        rethrow_exception(error);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        cerr << "Usage: " << argv[0] << " <moduli.inp> <output> [threads] [scratch_dir]" << endl;
+        return 1;
+    }
+
+    unsigned threads = (argc >= 4) ? stoul(argv[3]) : thread::hardware_concurrency();
+    if (threads == 0) {
+        threads = 1;
+    }
+    string scratchDir = (argc >= 5) ? argv[4] : ".";
+
+    ifstream in(argv[1]);
+    ofstream out(argv[2]);
+    if (!in.is_open() || !out.is_open()) {
+        cerr << "Error opening file(s)" << endl;
+        return 1;
+    }
+
+    // Mỗi dòng một modulus (hex đảo ngược)
+    vector<BigInt> level;
+    string line;
+    while (getline(in, line)) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (line.empty()) {
+            continue;
+        }
+        level.push_back(BigInt::fromHexReverse(line));
+    }
+    if (level.empty()) {
+        cerr << "No moduli in input" << endl;
+        return 1;
+    }
+    vector<BigInt> moduli = level;
+
+    try {
+        auto start = chrono::high_resolution_clock::now();
+
+        // 1. Product tree, mỗi tầng ghi ra scratch file rồi giải phóng khỏi RAM
+        ScratchFiles scratch{scratchDir, {}};
+        const vector<string>& levelFiles = scratch.paths;
+        while (true) {
+            writeLevel(scratch.create(), level);
+            if (level.size() == 1) {
+                break;
+            }
+
+            vector<BigInt> next((level.size() + 1) / 2);
+            parallelFor(next.size(), threads, [&](size_t i) {
+                if (2 * i + 1 < level.size()) {
+                    next[i] = BigInt::multiply(level[2 * i], level[2 * i + 1]);
+                } else {
+                    next[i] = level[2 * i];
+                }
+            });
+            level.swap(next);
+        }
+        auto productDone = chrono::high_resolution_clock::now();
+
+        // 2. Remainder tree: rem[i] = rem_cha mod node[i]^2, gốc thì rem = P
+        vector<BigInt> rem = level;
+        level.clear();
+        for (int k = (int)levelFiles.size() - 2; k >= 0; k--) {
+            MappedLevel mapped;
+            mapped.open(levelFiles[k]);
+
+            vector<BigInt> next(mapped.count);
+            parallelFor(next.size(), threads, [&](size_t i) {
+                BigInt node = mapped.node(i);
+                BigInt Q;
+                BigInt::divide(rem[i / 2], BigInt::multiply(node, node), Q, next[i]);
+            });
+
+            mapped.close();
+            rem.swap(next);
+        }
+        auto remainderDone = chrono::high_resolution_clock::now();
+
+        // 3. g_i = gcd(N_i, (P mod N_i^2) / N_i)
+        vector<BigInt> g(moduli.size());
+        parallelFor(moduli.size(), threads, [&](size_t i) {
+            BigInt Q, R;
+            BigInt::divide(rem[i], moduli[i], Q, R);
+            g[i] = BigInt::gcd(moduli[i], Q);
+        });
+        auto end = chrono::high_resolution_clock::now();
+
+        size_t weak = 0;
+        for (const BigInt& gi : g) {
+            out << gi.toHexReverse() << endl;
+            if (!(gi.a.size() == 1 && gi.a[0] == 1)) {
+                weak++;
+            }
+        }
+
+        chrono::duration<double, milli> productTime = productDone - start;
+        chrono::duration<double, milli> remainderTime = remainderDone - productDone;
+        chrono::duration<double, milli> gcdTime = end - remainderDone;
+        chrono::duration<double, milli> total = end - start;
+
+        cout << "Moduli: " << moduli.size() << ", sharing a factor: " << weak
+             << ", tree levels: " << levelFiles.size() << ", threads: " << threads << endl;
+        cout << "Product tree: " << productTime.count() << "ms" << endl;
+        cout << "Remainder tree: " << remainderTime.count() << "ms" << endl;
+        cout << "Leaf gcd: " << gcdTime.count() << "ms" << endl;
+        cout << "Time: " << total.count() << "ms" << endl;
+
+    } catch (const exception& ex) {
+        cerr << "An error occurred: " << ex.what() << endl;
+        return 1;
+    }
+
+    in.close();
+    out.close();
+
+    return 0;
+}
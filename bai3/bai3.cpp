@@ -4,9 +4,378 @@
 #include <fstream>
 #include <random>
 #include <algorithm>
+#include <chrono>
+#include <sstream>
+#include <iomanip>
+#include <thread>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cmath>
+#include <functional>
+#include <future>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
 using namespace std;
 
+// ---- Instrumentation ----
+// Trace bật lúc biên dịch: -DBAI3_TRACE_LEVEL=1 (mỗi lần gọi power) hoặc 2 (từng vòng lặp).
+// Mặc định 0: BAI3_TRACE bị loại bỏ hoàn toàn, biểu thức bên trong không được tính.
+#ifndef BAI3_TRACE_LEVEL
+#define BAI3_TRACE_LEVEL 0
+#endif
+
+#define BAI3_TRACE(level, expr)              \
+    do                                       \
+    {                                        \
+        if (BAI3_TRACE_LEVEL >= (level))     \
+            cerr << "TRACE: " << expr << "\n"; \
+    } while (0)
+
+// Bộ đếm luôn bật (thread_local, chỉ là phép cộng số nguyên)
+struct OpCounters
+{
+    uint64_t calls = 0;
+    uint64_t squarings = 0;
+    uint64_t multiplies = 0;
+    uint64_t reductions = 0;
+    uint64_t divisions = 0;
+    uint64_t allocations = 0;
+    uint64_t cycles = 0;
+
+    OpCounters operator-(const OpCounters &o) const
+    {
+        OpCounters r;
+        r.calls = calls - o.calls;
+        r.squarings = squarings - o.squarings;
+        r.multiplies = multiplies - o.multiplies;
+        r.reductions = reductions - o.reductions;
+        r.divisions = divisions - o.divisions;
+        r.allocations = allocations - o.allocations;
+        r.cycles = cycles - o.cycles;
+        return r;
+    }
+
+    OpCounters &operator+=(const OpCounters &o)
+    {
+        calls += o.calls;
+        squarings += o.squarings;
+        multiplies += o.multiplies;
+        reductions += o.reductions;
+        divisions += o.divisions;
+        allocations += o.allocations;
+        cycles += o.cycles;
+        return *this;
+    }
+
+    string toJson() const
+    {
+        stringstream ss;
+        ss << "{\"calls\":" << calls << ",\"squarings\":" << squarings << ",\"multiplies\":" << multiplies
+           << ",\"reductions\":" << reductions << ",\"divisions\":" << divisions
+           << ",\"allocations\":" << allocations << ",\"cycles\":" << cycles << "}";
+        return ss.str();
+    }
+};
+
+thread_local OpCounters g_totalCounters; // cộng dồn mọi lần gọi
+thread_local OpCounters g_lastCounters;  // lần gọi power() gần nhất
+
+static inline uint64_t readCycles()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+thread_local int g_callDepth = 0;
+
+// Đo một lần gọi: số liệu của lần gọi ghi vào g_lastCounters khi ra khỏi scope.
+// Scope lồng nhau (modexp -> power) chỉ được tính ở tầng ngoài cùng.
+struct CallScope
+{
+    OpCounters start;
+    uint64_t startCycles;
+
+    CallScope() : start(g_totalCounters), startCycles(readCycles()) { g_callDepth++; }
+    ~CallScope()
+    {
+        if (--g_callDepth > 0)
+            return;
+        g_totalCounters.calls++;
+        g_totalCounters.cycles += readCycles() - startCycles;
+        g_lastCounters = g_totalCounters - start;
+    }
+};
+
+const OpCounters &lastCallCounters() { return g_lastCounters; }
+const OpCounters &totalCounters() { return g_totalCounters; }
+void resetCounters()
+{
+    g_totalCounters = OpCounters();
+    g_lastCounters = OpCounters();
+}
+
+// Độ rộng cửa sổ theo số bit của số mũ (cùng ngưỡng với OpenSSL)
+int windowBits(int expBits)
+{
+    if (expBits > 671)
+        return 6;
+    if (expBits > 239)
+        return 5;
+    if (expBits > 79)
+        return 4;
+    if (expBits > 23)
+        return 3;
+    return 1;
+}
+
+// Bảng lũy thừa lẻ x^1, x^3, ..., x^(2^w - 1): một khối liền, căn lề 64 byte,
+// mỗi thread một bảng và dùng lại giữa các lần gọi (chỉ cấp phát lại khi cần lớn hơn)
+struct AlignedTable
+{
+    uint32_t *data = nullptr;
+    size_t capacity = 0; // số word
+
+    uint32_t *reserve(size_t words)
+    {
+        if (words > capacity)
+        {
+            free(data);
+            capacity = (words + 15) & ~(size_t)15;
+            data = (uint32_t *)aligned_alloc(64, capacity * sizeof(uint32_t));
+            g_totalCounters.allocations++;
+        }
+        return data;
+    }
+
+    ~AlignedTable() { free(data); }
+};
+
+thread_local AlignedTable g_windowTable;
+
+// Mỗi dòng của bảng bắt đầu ở đầu một cache line
+static inline size_t tableStride(size_t limbs)
+{
+    return (limbs + 15) & ~(size_t)15;
+}
+
+// ---- NTT (nhân số rất lớn) ----
+// Tích chập các word 32 bit theo ba số nguyên tố dạng c*2^k + 1 (< 2^30), ghép lại bằng CRT (Garner).
+// Mỗi hệ số tích chập <= min(na, nb) * (2^32 - 1)^2 < p1*p2*p3 ~ 2^86 khi độ dài biến đổi <= 2^23.
+// Biến đổi lớn chạy theo six-step: ma trận n1 x n2, DFT từng hàng ngắn (nằm gọn trong L1/L2),
+// nhân twiddle, chuyển vị theo khối. Phổ ra theo thứ tự hoán vị; nghịch biến đổi đi ngược đúng thứ tự đó
+// nên tích chập không cần đảo bit toàn mảng.
+const size_t NTT_MIN_WORDS = 512;         // min(na, nb) từ đây trở lên thì dùng NTT thay Comba (đo trên máy dev)
+const size_t NTT_MAX_LEN = (size_t)1 << 23;
+const size_t NTT_SIX_STEP_LEN = 1 << 16; // mảng <= 256 KB nằm gọn trong L2: một DFT liền cả mảng
+
+template <uint32_t P, uint32_t G>
+struct NttPrime
+{
+    static uint32_t mul(uint32_t a, uint32_t b) { return (uint32_t)((uint64_t)a * b % P); }
+    static uint32_t add(uint32_t a, uint32_t b) { return a + b >= P ? a + b - P : a + b; }
+    static uint32_t sub(uint32_t a, uint32_t b) { return a >= b ? a - b : a + P - b; }
+
+    static uint32_t pow(uint32_t a, uint64_t e)
+    {
+        uint32_t r = 1;
+        for (; e; e >>= 1, a = mul(a, a))
+            if (e & 1)
+                r = mul(r, a);
+        return r;
+    }
+
+    // căn nguyên thủy bậc n (hoặc nghịch đảo của nó)
+    static uint32_t root(size_t n, bool inverse)
+    {
+        uint32_t w = pow(G, (P - 1) / n);
+        return inverse ? pow(w, P - 2) : w;
+    }
+
+    // w^0, w^1, ..., w^(n/2 - 1), dựng một lần cho mỗi (n, chiều) rồi dùng lại (mỗi thread một bộ)
+    static const uint32_t *rootTable(size_t n, bool inverse)
+    {
+        thread_local vector<uint32_t> cache[2][24];
+        vector<uint32_t> &t = cache[inverse][__builtin_ctzll(n)];
+        if (t.empty())
+        {
+            uint32_t w = root(n, inverse);
+            t.resize(max<size_t>(n / 2, 1));
+            t[0] = 1;
+            for (size_t i = 1; i < n / 2; i++)
+                t[i] = mul(t[i - 1], w);
+        }
+        return t.data();
+    }
+
+    // DFT độ dài n trên một hàng liền, vào/ra theo thứ tự tự nhiên
+    static void dftRow(uint32_t *a, size_t n, const uint32_t *roots)
+    {
+        for (size_t i = 1, j = 0; i < n; i++)
+        {
+            size_t bit = n >> 1;
+            for (; j & bit; bit >>= 1)
+                j ^= bit;
+            j ^= bit;
+            if (i < j)
+                swap(a[i], a[j]);
+        }
+        for (size_t len = 2; len <= n; len <<= 1)
+        {
+            size_t half = len >> 1, step = n / len;
+            for (size_t i = 0; i < n; i += len)
+                for (size_t j = 0; j < half; j++)
+                {
+                    uint32_t u = a[i + j], v = mul(a[i + j + half], roots[j * step]);
+                    a[i + j] = add(u, v);
+                    a[i + j + half] = sub(u, v);
+                }
+        }
+    }
+
+    // a[j1*n2 + j2] *= w^(j1*j2) với w căn bậc n1*n2
+    static void twiddle(uint32_t *a, size_t n1, size_t n2, uint32_t w)
+    {
+        uint32_t rowStep = 1;
+        for (size_t j1 = 0; j1 < n1; j1++, rowStep = mul(rowStep, w))
+        {
+            uint32_t t = 1;
+            for (size_t j2 = 0; j2 < n2; j2++, t = mul(t, rowStep))
+                a[j1 * n2 + j2] = mul(a[j1 * n2 + j2], t);
+        }
+    }
+
+    static void transpose(const uint32_t *src, uint32_t *dst, size_t rows, size_t cols)
+    {
+        const size_t B = 16;
+        for (size_t r0 = 0; r0 < rows; r0 += B)
+            for (size_t c0 = 0; c0 < cols; c0 += B)
+                for (size_t r = r0; r < min(r0 + B, rows); r++)
+                    for (size_t c = c0; c < min(c0 + B, cols); c++)
+                        dst[c * rows + r] = src[r * cols + c];
+    }
+
+    // Thuận: a (n1 x n2) -> chuyển vị -> DFT n1 trên từng cột -> twiddle -> chuyển vị -> DFT n2 trên từng hàng.
+    // Nghịch: các bước ngược lại với căn nghịch đảo, chưa chia cho n.
+    static void transform(vector<uint32_t> &a, vector<uint32_t> &tmp, bool inverse)
+    {
+        size_t n = a.size();
+        if (n <= NTT_SIX_STEP_LEN)
+        {
+            dftRow(a.data(), n, rootTable(n, inverse));
+            return;
+        }
+
+        size_t n1 = (size_t)1 << (__builtin_ctzll(n) / 2), n2 = n / n1;
+        const uint32_t *r1 = rootTable(n1, inverse), *r2 = rootTable(n2, inverse);
+        uint32_t w = root(n, inverse);
+        tmp.resize(n);
+        if (!inverse)
+        {
+            transpose(a.data(), tmp.data(), n1, n2);
+            for (size_t j2 = 0; j2 < n2; j2++)
+                dftRow(tmp.data() + j2 * n1, n1, r1);
+            twiddle(tmp.data(), n2, n1, w);
+            transpose(tmp.data(), a.data(), n2, n1);
+            for (size_t k1 = 0; k1 < n1; k1++)
+                dftRow(a.data() + k1 * n2, n2, r2);
+        }
+        else
+        {
+            for (size_t k1 = 0; k1 < n1; k1++)
+                dftRow(a.data() + k1 * n2, n2, r2);
+            twiddle(a.data(), n1, n2, w);
+            transpose(a.data(), tmp.data(), n1, n2);
+            for (size_t j2 = 0; j2 < n2; j2++)
+                dftRow(tmp.data() + j2 * n1, n1, r1);
+            transpose(tmp.data(), a.data(), n2, n1);
+        }
+    }
+
+    // out = a * b mod P theo từng hệ số (độ dài n), b == a thì chỉ biến đổi một lần; fb, tmp là bộ đệm
+    static void convolve(vector<uint32_t> &out, const uint32_t *a, size_t na, const uint32_t *b, size_t nb, size_t n,
+                         vector<uint32_t> &fb, vector<uint32_t> &tmp)
+    {
+        out.assign(n, 0);
+        for (size_t i = 0; i < na; i++)
+            out[i] = a[i] % P;
+        transform(out, tmp, false);
+        const uint32_t *spec = out.data();
+        if (a != b || na != nb)
+        {
+            fb.assign(n, 0);
+            for (size_t i = 0; i < nb; i++)
+                fb[i] = b[i] % P;
+            transform(fb, tmp, false);
+            spec = fb.data();
+        }
+        uint32_t nInv = pow((uint32_t)(n % P), P - 2);
+        for (size_t i = 0; i < n; i++)
+            out[i] = mul(mul(out[i], spec[i]), nInv);
+        transform(out, tmp, true);
+    }
+};
+
+typedef NttPrime<998244353, 3> NttP1;
+typedef NttPrime<167772161, 3> NttP2;
+typedef NttPrime<469762049, 3> NttP3;
+
+// Bộ đệm của nttMultiply, giữ giữa các lần gọi cùng cỡ thì không cấp phát lại (Barrett giữ một bộ)
+struct NttScratch
+{
+    vector<uint32_t> c1, c2, c3, fb, tmp;
+};
+
+// out = a * b (na + nb word). false nếu quá độ dài NTT hỗ trợ.
+static bool nttMultiply(vector<uint32_t> &out, const uint32_t *a, size_t na, const uint32_t *b, size_t nb,
+                        NttScratch &s)
+{
+    size_t n = 1;
+    while (n < na + nb - 1)
+        n <<= 1;
+    if (n > NTT_MAX_LEN)
+        return false;
+
+    vector<uint32_t> &c1 = s.c1, &c2 = s.c2, &c3 = s.c3;
+    NttP1::convolve(c1, a, na, b, nb, n, s.fb, s.tmp);
+    NttP2::convolve(c2, a, na, b, nb, n, s.fb, s.tmp);
+    NttP3::convolve(c3, a, na, b, nb, n, s.fb, s.tmp);
+
+    // Garner: x = r1 + p1 * t2 + p1 * p2 * t3
+    const uint64_t p1 = 998244353, p2 = 167772161, p3 = 469762049;
+    const uint32_t inv12 = NttP2::pow(p1 % p2, p2 - 2);
+    const uint32_t inv123 = NttP3::pow((uint32_t)(p1 * p2 % p3), p3 - 2);
+    out.resize(na + nb);
+    unsigned __int128 acc = 0;
+    for (size_t k = 0; k + 1 < na + nb; k++)
+    {
+        uint32_t t2 = NttP2::mul(NttP2::sub(c2[k], c1[k] % p2), inv12);
+        uint64_t x12 = c1[k] + p1 * t2;
+        uint32_t t3 = NttP3::mul(NttP3::sub(c3[k], (uint32_t)(x12 % p3)), inv123);
+        acc += x12 + (unsigned __int128)(p1 * p2) * t3;
+        out[k] = (uint32_t)acc;
+        acc >>= 32;
+    }
+    out[na + nb - 1] = (uint32_t)acc;
+    return true;
+}
+
+// Tích lẻ: bộ đệm tạm (không giữ lại vài chục MB sau một phép nhân rất lớn)
+static bool nttMultiply(vector<uint32_t> &out, const uint32_t *a, size_t na, const uint32_t *b, size_t nb)
+{
+    NttScratch s;
+    return nttMultiply(out, a, na, b, nb, s);
+}
+
 struct BigInt
 {
     static const uint64_t BASE = (1ULL << 32);
@@ -36,6 +405,18 @@ struct BigInt
         return a.size() == 1 && a[0] == 0;
     }
 
+    uint32_t bit(int i) const
+    {
+        return (a[i / 32] >> (i % 32)) & 1;
+    }
+
+    int bitLength() const
+    {
+        if (isZero())
+            return 0;
+        return (int)(a.size() - 1) * 32 + (32 - __builtin_clz(a.back()));
+    }
+
     void trim()
     {
         while (a.size() > 1 && a.back() == 0)
@@ -107,24 +488,51 @@ struct BigInt
 
     static BigInt multiply(const BigInt &A, const BigInt &B)
     {
+        g_totalCounters.allocations++;
         BigInt C;
-        C.a.resize(A.a.size() + B.a.size());
-        for (size_t i = 0; i < A.a.size(); i++)
+        mulInto(C, A, B);
+        return C;
+    }
+
+    // dst = A * B: hai thừa số cùng từ NTT_MIN_WORDS word trở lên thì đi NTT, còn lại Comba.
+    // dst giữ lại vùng nhớ cũ nên gọi lặp lại không cấp phát; dst trùng A hoặc B thì tính qua bản tạm.
+    static void mulInto(BigInt &dst, const BigInt &A, const BigInt &B)
+    {
+        if (&dst == &A || &dst == &B)
         {
-            uint64_t carry = 0;
-            for (size_t j = 0; j < B.a.size() || carry; j++)
-            {
-                uint64_t prod = C.a[i + j] + carry;
-                if (j < B.a.size())
-                {
-                    prod += uint64_t(A.a[i]) * uint64_t(B.a[j]);
-                }
-                C.a[i + j] = prod % BASE;
-                carry = prod / BASE;
-            }
+            BigInt tmp;
+            mulInto(tmp, A, B);
+            dst.a.swap(tmp.a);
+            return;
         }
-        C.trim();
-        return C;
+
+        const size_t na = A.a.size(), nb = B.a.size();
+        const uint32_t *a = A.a.data(), *b = B.a.data();
+        if (min(na, nb) >= NTT_MIN_WORDS && nttMultiply(dst.a, a, na, b, nb))
+        {
+            dst.trim();
+            return;
+        }
+        dst.a.resize(na + nb);
+        mulComba(dst.a.data(), a, na, b, nb);
+        dst.trim();
+    }
+
+    // c = a * b (na + nb word) theo cột (Comba): mỗi cột k cộng mọi a[i]*b[k-i] vào bộ tích lũy 128 bit,
+    // ghi đúng một word rồi dịch bộ tích lũy 32 bit. Vòng trong không rẽ nhánh theo dữ liệu.
+    static void mulComba(uint32_t *c, const uint32_t *a, size_t na, const uint32_t *b, size_t nb)
+    {
+        unsigned __int128 acc = 0;
+        for (size_t k = 0; k + 1 < na + nb; k++)
+        {
+            size_t lo = k >= nb ? k - nb + 1 : 0;
+            size_t hi = min(k, na - 1);
+            for (size_t i = lo; i <= hi; i++)
+                acc += (uint64_t)a[i] * b[k - i];
+            c[k] = (uint32_t)acc;
+            acc >>= 32;
+        }
+        c[na + nb - 1] = (uint32_t)acc;
     }
 
     static BigInt divide(const BigInt &A, const BigInt &B, BigInt &R)
@@ -137,6 +545,8 @@ struct BigInt
         if (B.isZero())
             throw runtime_error("Division by zero");
 
+        g_totalCounters.divisions++;
+
         // ✅ Fast path: if B is small (≤ 32-bit), use divInt
         if (B.a.size() == 1)
         {
@@ -147,42 +557,78 @@ struct BigInt
             return Q;
         }
 
-        // ✅ General case: long division with FAST binary search (no multiply per iteration)
+        // ✅ General case: Knuth Algorithm D
+        g_totalCounters.allocations += 2;
+        size_t n = B.a.size();
+        size_t m = A.a.size();
+
+        // Chuẩn hoá: dịch trái để bit cao nhất của B bằng 1
+        int s = __builtin_clz(B.a[n - 1]);
+        vector<uint32_t> vn(n), un(m + 1);
+        for (size_t i = n - 1; i > 0; i--)
+            vn[i] = (B.a[i] << s) | (s ? (uint32_t)((uint64_t)B.a[i - 1] >> (32 - s)) : 0);
+        vn[0] = B.a[0] << s;
+        un[m] = s ? (uint32_t)((uint64_t)A.a[m - 1] >> (32 - s)) : 0;
+        for (size_t i = m - 1; i > 0; i--)
+            un[i] = (A.a[i] << s) | (s ? (uint32_t)((uint64_t)A.a[i - 1] >> (32 - s)) : 0);
+        un[0] = A.a[0] << s;
+
         BigInt Q;
-        R = BigInt(0);
-        Q.a.resize(A.a.size());
-        for (int i = (int)A.a.size() - 1; i >= 0; i--)
+        Q.a.assign(m - n + 1, 0);
+        for (int j = (int)(m - n); j >= 0; j--)
         {
-            R = multiply(R, BigInt(BASE));
-            if (R.a.empty())
-                R.a.push_back(0);
-            R.a[0] = A.a[i];
-            R.trim();
-
-            // Binary search for x such that B*x <= R < B*(x+1)
-            uint32_t left = 0, right = BASE - 1;
-            uint32_t x = 0;
-            while (left <= right)
-            {
-                uint32_t mid = left + (right - left) / 2;
-                BigInt t = multiply(B, BigInt(mid));
-                int cmp = compare(t, R);
-                if (cmp <= 0)
-                {
-                    x = mid;
-                    left = mid + 1;
-                }
-                else
+            // Ước lượng chữ số thương từ 2 word cao, sửa tối đa 2 lần
+            uint64_t num = ((uint64_t)un[j + n] << 32) | un[j + n - 1];
+            uint64_t qhat = num / vn[n - 1];
+            uint64_t rhat = num % vn[n - 1];
+            while (qhat >= BASE || qhat * vn[n - 2] > ((rhat << 32) | un[j + n - 2]))
+            {
+                qhat--;
+                rhat += vn[n - 1];
+                if (rhat >= BASE)
+                    break;
+            }
+
+            // un[j..j+n] -= qhat * vn (tại chỗ)
+            int64_t borrow = 0;
+            uint64_t carry = 0;
+            for (size_t i = 0; i < n; i++)
+            {
+                uint64_t p = qhat * vn[i] + carry;
+                carry = p >> 32;
+                int64_t t = (int64_t)un[i + j] - (int64_t)(uint32_t)p - borrow;
+                un[i + j] = (uint32_t)t;
+                borrow = (t < 0) ? 1 : 0;
+            }
+            int64_t t = (int64_t)un[j + n] - (int64_t)carry - borrow;
+            un[j + n] = (uint32_t)t;
+
+            // qhat lớn hơn 1: cộng trả lại B
+            if (t < 0)
+            {
+                qhat--;
+                uint64_t c = 0;
+                for (size_t i = 0; i < n; i++)
                 {
-                    right = mid - 1;
+                    uint64_t sum = (uint64_t)un[i + j] + vn[i] + c;
+                    un[i + j] = (uint32_t)sum;
+                    c = sum >> 32;
                 }
+                un[j + n] += (uint32_t)c;
             }
-            Q.a[i] = x;
-            R = subtract(R, multiply(B, BigInt(x)));
+            Q.a[j] = (uint32_t)qhat;
         }
         Q.trim();
+
+        // Phần dư = un[0..n-1] dịch phải lại s bit
+        R.a.assign(n, 0);
+        for (size_t i = 0; i < n; i++)
+            R.a[i] = (un[i] >> s) | (s ? (uint32_t)((uint64_t)un[i + 1] << (32 - s)) : 0);
+        R.trim();
         return Q;
-    } // static BigInt mod(const BigInt &A, const BigInt &B) {
+    }
+
+    // static BigInt mod(const BigInt &A, const BigInt &B) {
     //     BigInt R;
     //     R.a.clear();
     //     BigInt cur;
@@ -217,6 +663,7 @@ struct BigInt
             return A;
         if (B.isZero())
             throw runtime_error("Modulo by zero");
+        g_totalCounters.reductions++;
 
         // Use divide to get remainder efficiently
         BigInt tempA = A; // make a copy since divide may modify first arg
@@ -225,133 +672,2205 @@ struct BigInt
         return remainder;
     }
 
-    static BigInt power(BigInt base, BigInt exp, const BigInt &mod)
+    // ---- Montgomery (chỉ dùng cho modulo lẻ) ----
+    struct MontgomeryCtx
     {
-        BigInt result(1);
-        base = modBig(base, mod);
-        int iter = 0;
+        vector<uint32_t> N;  // modulus, đúng n word
+        vector<uint32_t> R2; // R^2 mod N với R = 2^(32n)
+        uint32_t n_inv;      // -N^{-1} mod 2^32
+    };
 
-        cerr << "Starting power() exp_words=" << exp.a.size() << "\n";
-
-        while (!exp.isZero())
-        {
-            cout << "DBG: power loop iter=" << iter << " exp(HEX)=" << exp.toHex() << "\n";
-            if (++iter % 1000 == 0)
-                cerr << "power: iter=" << iter << " exp_words=" << exp.a.size() << "\n";
+    // tính n_inv = -N^{-1} mod 2^32
+    static uint32_t montgomeryInv32(uint32_t n)
+    {
+        uint32_t x = n;
+        for (int i = 0; i < 5; ++i)
+            x *= 2 - n * x;
+        return ~x + 1;
+    }
 
-            if (exp.a[0] & 1)
-                result = modBig(multiply(result, base), mod);
+    static MontgomeryCtx montInit(const BigInt &N)
+    {
+        MontgomeryCtx ctx;
+        ctx.N = N.a;
+        ctx.n_inv = montgomeryInv32(N.a[0]);
 
-            shiftRight1(exp); // ✅ thay cho chia exp / 2
-            base = modBig(multiply(base, base), mod);
-        }
+        // R^2 mod N: một lần chia duy nhất
+        BigInt R2;
+        R2.a.assign(2 * N.a.size() + 1, 0);
+        R2.a.back() = 1;
+        R2 = modBig(R2, N);
+        R2.a.resize(N.a.size(), 0);
+        ctx.R2 = R2.a;
+        return ctx;
+    }
 
-        cerr << "Finished power(), total iters=" << iter << "\n";
-        return result;
+    static void montMul(vector<uint32_t> &res, const vector<uint32_t> &a, const vector<uint32_t> &b, const MontgomeryCtx &ctx)
+    {
+        res.resize(ctx.N.size());
+        montMulRaw(res.data(), a.data(), b.data(), ctx);
     }
 
-    static void shiftRight1(BigInt &A)
+    // res = a * b * R^-1 mod N (CIOS), a và b đúng n word và < N, res được phép trùng a hoặc b.
+    // Bộ đệm n + 2 word là thread_local, chỉ cấp phát lại khi gặp N dài hơn (như g_windowTable).
+    static void montMulRaw(uint32_t *res, const uint32_t *a, const uint32_t *b, const MontgomeryCtx &ctx)
     {
-        uint32_t carry = 0;
-        for (int i = (int)A.a.size() - 1; i >= 0; i--)
+        size_t n = ctx.N.size();
+        g_totalCounters.reductions++;
+        thread_local vector<uint32_t> scratch;
+        if (scratch.size() < n + 2)
         {
-            uint64_t cur = ((uint64_t)carry << 32) | A.a[i];
-            A.a[i] = (uint32_t)(cur >> 1);
-            carry = (uint32_t)(cur & 1);
+            scratch.resize(n + 2);
+            g_totalCounters.allocations++;
         }
-        A.trim();
-        if (A.a.empty())
-            A.a.push_back(0);
-    }
+        uint32_t *t = scratch.data();
+        fill(t, t + n + 2, 0);
+        for (size_t i = 0; i < n; i++)
+        {
+            uint64_t carry = 0;
+            for (size_t j = 0; j < n; j++)
+            {
+                uint64_t cur = (uint64_t)t[j] + (uint64_t)a[i] * b[j] + carry;
+                t[j] = (uint32_t)cur;
+                carry = cur >> 32;
+            }
+            uint64_t cur = (uint64_t)t[n] + carry;
+            t[n] = (uint32_t)cur;
+            t[n + 1] = (uint32_t)(cur >> 32);
 
-    static BigInt fromHex(string s)
-    {
-        BigInt r(0);
-        uint64_t val = 0;
-        int cnt = 0;
-        for (int i = (int)s.size() - 1; i >= 0; i--)
+            // cộng m * N để word thấp bằng 0 rồi dịch phải 1 word
+            uint32_t m = t[0] * ctx.n_inv;
+            cur = (uint64_t)t[0] + (uint64_t)m * ctx.N[0];
+            carry = cur >> 32;
+            for (size_t j = 1; j < n; j++)
+            {
+                cur = (uint64_t)t[j] + (uint64_t)m * ctx.N[j] + carry;
+                t[j - 1] = (uint32_t)cur;
+                carry = cur >> 32;
+            }
+            cur = (uint64_t)t[n] + carry;
+            t[n - 1] = (uint32_t)cur;
+            t[n] = t[n + 1] + (uint32_t)(cur >> 32);
+        }
+
+        // nếu t >= N thì trừ N
+        bool geq = t[n] != 0;
+        if (!geq)
         {
-            char c = s[i];
-            uint32_t v = (c >= '0' && c <= '9') ? c - '0' : (toupper(c) - 'A' + 10);
-            val |= (uint64_t(v) << (4 * cnt++));
-            if (cnt == 8)
+            geq = true;
+            for (int i = (int)n - 1; i >= 0; i--)
             {
-                r.a.push_back(uint32_t(val));
-                val = 0;
-                cnt = 0;
+                if (t[i] != ctx.N[i])
+                {
+                    geq = t[i] > ctx.N[i];
+                    break;
+                }
             }
         }
-        if (cnt)
-            r.a.push_back(uint32_t(val));
-        r.trim();
-        return r;
+        if (geq)
+        {
+            uint64_t borrow = 0;
+            for (size_t i = 0; i < n; i++)
+            {
+                uint64_t diff = (uint64_t)t[i] - ctx.N[i] - borrow;
+                t[i] = (uint32_t)diff;
+                borrow = (diff >> 63);
+            }
+        }
+        copy(t, t + n, res);
     }
 
-    string toHex() const
+    // res = a^2 * R^-1 mod N: tích chéo a[i]*a[j] (i < j) tính một lần rồi nhân đôi, cộng đường chéo,
+    // sau đó rút gọn Montgomery từng word (SOS). t là bộ đệm 2n + 1 word của người gọi, không cấp phát.
+    static void montSqrRaw(uint32_t *res, const uint32_t *a, const MontgomeryCtx &ctx, uint32_t *t)
     {
-        if (isZero())
-            return "0";
-        string s;
-        for (size_t i = 0; i < a.size(); i++)
+        size_t n = ctx.N.size();
+        const uint32_t *N = ctx.N.data();
+        g_totalCounters.reductions++;
+        fill(t, t + 2 * n + 1, 0);
+        for (size_t i = 0; i < n; i++)
         {
-            for (int j = 0; j < 8; j++)
+            uint64_t carry = 0;
+            for (size_t j = i + 1; j < n; j++)
             {
-                uint32_t nibble = (a[i] >> (4 * j)) & 0xF;
-                char c = (nibble < 10) ? ('0' + nibble) : ('A' + nibble - 10);
-                s.push_back(c);
+                uint64_t cur = (uint64_t)t[i + j] + (uint64_t)a[i] * a[j] + carry;
+                t[i + j] = (uint32_t)cur;
+                carry = cur >> 32;
             }
+            t[i + n] = (uint32_t)carry;
         }
-        while (s.size() > 1 && s.back() == '0')
+        uint64_t carry = 0;
+        for (size_t i = 0; i < n; i++)
         {
-            s.pop_back();
+            uint64_t sq = (uint64_t)a[i] * a[i];
+            uint64_t lo = ((uint64_t)t[2 * i] << 1) + (uint32_t)sq + carry;
+            t[2 * i] = (uint32_t)lo;
+            uint64_t hi = ((uint64_t)t[2 * i + 1] << 1) + (sq >> 32) + (lo >> 32);
+            t[2 * i + 1] = (uint32_t)hi;
+            carry = hi >> 32;
         }
-        reverse(s.begin(), s.end());
-        return s;
-    }
 
-    static uint32_t divInt(BigInt &A, uint32_t B)
-    {
-        uint64_t rem = 0;
-        for (int i = (int)A.a.size() - 1; i >= 0; i--)
+        // word i: cộng m * N * 2^(32i) để t[i] = 0; kết quả t[n..2n] < 2N
+        for (size_t i = 0; i < n; i++)
         {
-            uint64_t cur = (uint64_t)rem * BASE + A.a[i];
-            A.a[i] = uint32_t(cur / B);
-            rem = cur % B;
+            uint32_t m = t[i] * ctx.n_inv;
+            carry = 0;
+            for (size_t j = 0; j < n; j++)
+            {
+                uint64_t cur = (uint64_t)t[i + j] + (uint64_t)m * N[j] + carry;
+                t[i + j] = (uint32_t)cur;
+                carry = cur >> 32;
+            }
+            for (size_t k = i + n; carry && k <= 2 * n; k++)
+            {
+                uint64_t cur = (uint64_t)t[k] + carry;
+                t[k] = (uint32_t)cur;
+                carry = cur >> 32;
+            }
         }
-        A.trim();
-        return uint32_t(rem);
+
+        uint32_t *r = t + n;
+        bool geq = r[n] != 0;
+        if (!geq)
+        {
+            geq = true;
+            for (int i = (int)n - 1; i >= 0; i--)
+                if (r[i] != N[i])
+                {
+                    geq = r[i] > N[i];
+                    break;
+                }
+        }
+        if (geq)
+        {
+            uint64_t borrow = 0;
+            for (size_t i = 0; i < n; i++)
+            {
+                uint64_t diff = (uint64_t)r[i] - N[i] - borrow;
+                r[i] = (uint32_t)diff;
+                borrow = diff >> 63;
+            }
+        }
+        copy(r, r + n, res);
     }
-};
 
-string toBigEndianHex(const string &littleHex)
-{
-    string s = littleHex;
-    if (s.size() <= 2)
-        return s; // ✅ không đảo nếu chỉ 1 byte
-    if (s.size() % 2)
-        s = "0" + s;
-    string res;
-    for (int i = s.size(); i > 0; i -= 2)
-        res += s.substr(i - 2, 2);
-    return res;
-}
+    // Cửa sổ trượt trái -> phải: start(idx) cho cửa sổ đầu tiên, sqr() mỗi lần bình phương,
+    // mul(idx) nhân với x^(2*idx + 1). Trả về false nếu exp = 0.
+    template <class Start, class Sqr, class Mul>
+    static bool slidingWindow(const BigInt &exp, int w, Start start, Sqr sqr, Mul mul)
+    {
+        bool started = false;
+        for (int i = exp.bitLength() - 1; i >= 0;)
+        {
+            if (!exp.bit(i))
+            {
+                sqr();
+                i--;
+                continue;
+            }
 
-string toLittleEndianHex(const string &bigHex)
-{
-    string s = bigHex;
-    if (s.size() % 2)
-        s = "0" + s;
-    string res;
-    for (size_t i = 0; i < s.size(); i += 2)
-        res = s.substr(i, 2) + res;
-    return res;
-}
+            int l = max(0, i - w + 1);
+            while (!exp.bit(l))
+                l++;
+            uint32_t win = 0;
+            for (int j = i; j >= l; j--)
+                win = (win << 1) | exp.bit(j);
 
-int main()
+            if (started)
+            {
+                for (int j = l; j <= i; j++)
+                    sqr();
+                mul(win >> 1);
+            }
+            else
+            {
+                start(win >> 1);
+                started = true;
+            }
+            i = l - 1;
+        }
+        return started;
+    }
+
+    static BigInt montPower(const BigInt &base, const BigInt &exp, const MontgomeryCtx &ctx)
+    {
+        size_t n = ctx.N.size();
+        BigInt N;
+        N.a = ctx.N;
+
+        // phép chia duy nhất trong vòng lặp: base mod N
+        vector<uint32_t> x = modBig(base, N).a;
+        x.resize(n, 0);
+        montMul(x, x, ctx.R2, ctx);
+
+        vector<uint32_t> result;
+        montPowerMont(result, x, exp, ctx);
+
+        vector<uint32_t> one(n, 0);
+        one[0] = 1;
+        BigInt r;
+        montMul(r.a, result, one, ctx);
+        r.trim();
+        return r;
+    }
+
+    // result = x^exp, cả hai ở dạng Montgomery (exp = 0 cho R mod N)
+    static void montPowerMont(vector<uint32_t> &result, const vector<uint32_t> &x, const BigInt &exp, const MontgomeryCtx &ctx)
+    {
+        size_t n = ctx.N.size();
+        vector<uint32_t> one(n, 0);
+        one[0] = 1;
+        montMul(result, one, ctx.R2, ctx);
+
+        // bảng x^1, x^3, ..., x^(2^w - 1) dạng Montgomery
+        int w = windowBits(exp.bitLength());
+        size_t stride = tableStride(n);
+        uint32_t *table = g_windowTable.reserve(stride << (w - 1));
+        copy(x.begin(), x.end(), table);
+        if (w > 1)
+        {
+            vector<uint32_t> x2;
+            g_totalCounters.squarings++;
+            montMul(x2, x, x, ctx);
+            for (size_t i = 1; i < ((size_t)1 << (w - 1)); i++)
+            {
+                g_totalCounters.multiplies++;
+                montMulRaw(table + i * stride, table + (i - 1) * stride, x2.data(), ctx);
+            }
+        }
+
+        slidingWindow(
+            exp, w,
+            [&](uint32_t idx)
+            { copy(table + idx * stride, table + idx * stride + n, result.begin()); },
+            [&]()
+            {
+                g_totalCounters.squarings++;
+                montMulRaw(result.data(), result.data(), result.data(), ctx);
+            },
+            [&](uint32_t idx)
+            {
+                g_totalCounters.multiplies++;
+                montMulRaw(result.data(), result.data(), table + idx * stride, ctx);
+            });
+    }
+
+    static BigInt power(BigInt base, BigInt exp, const BigInt &mod)
+    {
+        CallScope scope;
+        BAI3_TRACE(1, "power() exp_words=" << exp.a.size() << " mod_words=" << mod.a.size());
+
+        // Modulo lẻ: Montgomery, chỉ cần chia cho base mod N và R^2
+        if ((mod.a[0] & 1) && compare(mod, BigInt(1)) > 0)
+            return montPower(base, exp, montInit(mod));
+
+        // Modulo chẵn: cửa sổ trượt, mỗi phép nhân một lần chia
+        base = modBig(base, mod);
+        int w = windowBits(exp.bitLength());
+        vector<BigInt> table(1 << (w - 1));
+        table[0] = base;
+        if (w > 1)
+        {
+            g_totalCounters.squarings++;
+            BigInt prod;
+            mulInto(prod, base, base);
+            BigInt base2 = modBig(prod, mod);
+            for (size_t i = 1; i < table.size(); i++)
+            {
+                g_totalCounters.multiplies++;
+                mulInto(prod, table[i - 1], base2);
+                table[i] = modBig(prod, mod);
+            }
+        }
+
+        // prod dùng lại qua mọi vòng lặp: mulInto không cấp phát tích tạm
+        BigInt result(1), prod;
+        int iter = 0;
+        bool nonZeroExp = slidingWindow(
+            exp, w,
+            [&](uint32_t idx)
+            { result = table[idx]; },
+            [&]()
+            {
+                BAI3_TRACE(2, "power loop iter=" << iter);
+                iter++;
+                g_totalCounters.squarings++;
+                mulInto(prod, result, result);
+                result = modBig(prod, mod);
+            },
+            [&](uint32_t idx)
+            {
+                g_totalCounters.multiplies++;
+                mulInto(prod, result, table[idx]);
+                result = modBig(prod, mod);
+            });
+        if (!nonZeroExp)
+            result = modBig(BigInt(1), mod);
+
+        BAI3_TRACE(1, "power() done, squarings=" << iter);
+        return result;
+    }
+
+    static void shiftRight1(BigInt &A)
+    {
+        uint32_t carry = 0;
+        for (int i = (int)A.a.size() - 1; i >= 0; i--)
+        {
+            uint64_t cur = ((uint64_t)carry << 32) | A.a[i];
+            A.a[i] = (uint32_t)(cur >> 1);
+            carry = (uint32_t)(cur & 1);
+        }
+        A.trim();
+        if (A.a.empty())
+            A.a.push_back(0);
+    }
+
+    static BigInt fromHex(string s)
+    {
+        BigInt r;
+        r.a.clear();
+        uint64_t val = 0;
+        int cnt = 0;
+        for (int i = (int)s.size() - 1; i >= 0; i--)
+        {
+            char c = s[i];
+            uint32_t v = (c >= '0' && c <= '9') ? c - '0' : (toupper(c) - 'A' + 10);
+            val |= (uint64_t(v) << (4 * cnt++));
+            if (cnt == 8)
+            {
+                r.a.push_back(uint32_t(val));
+                val = 0;
+                cnt = 0;
+            }
+        }
+        if (cnt)
+            r.a.push_back(uint32_t(val));
+        if (r.a.empty())
+            r.a.push_back(0);
+        r.trim();
+        return r;
+    }
+
+    string toHex() const
+    {
+        if (isZero())
+            return "0";
+        string s;
+        for (size_t i = 0; i < a.size(); i++)
+        {
+            for (int j = 0; j < 8; j++)
+            {
+                uint32_t nibble = (a[i] >> (4 * j)) & 0xF;
+                char c = (nibble < 10) ? ('0' + nibble) : ('A' + nibble - 10);
+                s.push_back(c);
+            }
+        }
+        while (s.size() > 1 && s.back() == '0')
+        {
+            s.pop_back();
+        }
+        reverse(s.begin(), s.end());
+        return s;
+    }
+
+    static uint32_t divInt(BigInt &A, uint32_t B)
+    {
+        uint64_t rem = 0;
+        for (int i = (int)A.a.size() - 1; i >= 0; i--)
+        {
+            uint64_t cur = (uint64_t)rem * BASE + A.a[i];
+            A.a[i] = uint32_t(cur / B);
+            rem = cur % B;
+        }
+        A.trim();
+        return uint32_t(rem);
+    }
+};
+
+// ---- Native engine: N vừa 64 bit (như bai3_ver2.cpp) ----
+uint64_t toU64(const BigInt &A)
+{
+    uint64_t v = A.a[0];
+    if (A.a.size() > 1)
+        v |= (uint64_t)A.a[1] << 32;
+    return v;
+}
+
+uint64_t nativeModPow(uint64_t base, const BigInt &exp, uint64_t mod)
+{
+    uint64_t result = 1 % mod;
+    for (int i = exp.bitLength() - 1; i >= 0; i--)
+    {
+        g_totalCounters.squarings++;
+        g_totalCounters.reductions++;
+        result = (uint64_t)((__uint128_t)result * result % mod);
+        if ((exp.a[i / 32] >> (i % 32)) & 1)
+        {
+            g_totalCounters.multiplies++;
+            g_totalCounters.reductions++;
+            result = (uint64_t)((__uint128_t)result * base % mod);
+        }
+    }
+    return result;
+}
+
+// ---- AVX-512 IFMA (radix 2^52, như bai3_fixed.cpp) cho FixedMontgomery từ 2048 bit ----
+// Số lưu thành digit 52 bit trong uint64, số digit làm tròn lên bội của 8 (một thanh ghi zmm).
+// Dưới ~768 bit phần chuyển radix không bù được, nên chỉ bật cho FixedMontgomery<64/96/128>.
+#if defined(__x86_64__)
+#define BAI3_HAVE_IFMA 1
+#endif
+
+const uint64_t MASK52 = (1ULL << 52) - 1;
+const int IFMA_MIN_LIMBS = 64;
+
+// chọn lúc khởi động theo CPUID, bench tắt đi để so với kernel 32 bit
+#ifdef BAI3_HAVE_IFMA
+bool g_useIfma = __builtin_cpu_supports("avx512ifma");
+#else
+bool g_useIfma = false;
+#endif
+
+// limbs word 32 bit <-> digits digit 52 bit
+void toRadix52(uint64_t *out, const uint32_t *a, int limbs, int digits)
+{
+    __uint128_t acc = 0;
+    int bits = 0, i = 0;
+    for (int d = 0; d < digits; d++)
+    {
+        while (bits < 52 && i < limbs)
+        {
+            acc |= (__uint128_t)a[i++] << bits;
+            bits += 32;
+        }
+        out[d] = (uint64_t)acc & MASK52;
+        acc >>= 52;
+        bits = max(0, bits - 52);
+    }
+}
+
+void fromRadix52(uint32_t *out, const uint64_t *in, int digits, int limbs)
+{
+    __uint128_t acc = 0;
+    int bits = 0, i = 0;
+    for (int d = 0; d < digits && i < limbs; d++)
+    {
+        acc |= (__uint128_t)in[d] << bits;
+        bits += 52;
+        while (bits >= 32 && i < limbs)
+        {
+            out[i++] = (uint32_t)acc;
+            acc >>= 32;
+            bits -= 32;
+        }
+    }
+    for (; i < limbs; i++)
+    {
+        out[i] = (uint32_t)acc;
+        acc >>= 32;
+    }
+}
+
+#ifdef BAI3_HAVE_IFMA
+// digit thấp nhất của thanh ghi; bản maskz vì cast không mask đọc _mm_undefined (-Wmaybe-uninitialized)
+__attribute__((target("avx512f"))) static inline uint64_t ifmaLane0(__m512i x)
+{
+    return _mm_cvtsi128_si64(_mm512_maskz_extracti32x4_epi32(0xF, x, 0));
+}
+
+// res = a * b * 2^(-52*DIGITS) mod N, a < 2^(52*DIGITS), b < N. Lane tích lũy chưa chuẩn hóa
+// (mỗi vòng cộng < 2^54 nên 80 digit vẫn vừa 64 bit), chuẩn hóa nhớ và trừ N một lần ở cuối.
+template <int DIGITS>
+__attribute__((target("avx512f,avx512ifma"))) void ifmaMontMul(uint64_t *res, const uint64_t *a, const uint64_t *b,
+                                                                const uint64_t *N, uint64_t k0)
+{
+    const int V = DIGITS / 8;
+    const __m512i zero = _mm512_setzero_si512();
+    __m512i X[V], A[V], M[V];
+    for (int v = 0; v < V; v++)
+    {
+        X[v] = zero;
+        A[v] = _mm512_load_si512(a + 8 * v);
+        M[v] = _mm512_load_si512(N + 8 * v);
+    }
+
+    for (int i = 0; i < DIGITS; i++)
+    {
+        __m512i bi = _mm512_set1_epi64(b[i]);
+        for (int v = 0; v < V; v++)
+            X[v] = _mm512_madd52lo_epu64(X[v], A[v], bi);
+        __m512i y = _mm512_set1_epi64((ifmaLane0(X[0]) * k0) & MASK52);
+        for (int v = 0; v < V; v++)
+            X[v] = _mm512_madd52lo_epu64(X[v], M[v], y);
+
+        // digit 0 giờ chia hết cho 2^52: dịch đi một digit, nhớ của nó cộng vào digit mới
+        uint64_t carry = ifmaLane0(X[0]) >> 52;
+        for (int v = 0; v < V - 1; v++)
+            X[v] = _mm512_maskz_alignr_epi64(0xFF, X[v + 1], X[v], 1);
+        X[V - 1] = _mm512_maskz_alignr_epi64(0xFF, zero, X[V - 1], 1);
+        X[0] = _mm512_add_epi64(X[0], _mm512_maskz_set1_epi64(1, carry));
+
+        for (int v = 0; v < V; v++)
+        {
+            X[v] = _mm512_madd52hi_epu64(X[v], A[v], bi);
+            X[v] = _mm512_madd52hi_epu64(X[v], M[v], y);
+        }
+    }
+
+    alignas(64) uint64_t t[DIGITS];
+    for (int v = 0; v < V; v++)
+        _mm512_store_si512(t + 8 * v, X[v]);
+    uint64_t carry = 0;
+    for (int d = 0; d < DIGITS; d++)
+    {
+        uint64_t cur = t[d] + carry;
+        t[d] = cur & MASK52;
+        carry = cur >> 52;
+    }
+
+    // kết quả < 2N: trừ N nếu tràn hoặc >= N
+    bool ge = carry != 0;
+    if (!ge)
+    {
+        ge = true;
+        for (int d = DIGITS - 1; d >= 0; d--)
+            if (t[d] != N[d])
+            {
+                ge = t[d] > N[d];
+                break;
+            }
+    }
+    if (ge)
+    {
+        uint64_t borrow = 0;
+        for (int d = 0; d < DIGITS; d++)
+        {
+            uint64_t cur = t[d] - N[d] - borrow;
+            t[d] = cur & MASK52;
+            borrow = cur >> 63;
+        }
+    }
+    copy(t, t + DIGITS, res);
+}
+#else
+template <int DIGITS>
+void ifmaMontMul(uint64_t *, const uint64_t *, const uint64_t *, const uint64_t *, uint64_t) {}
+#endif
+
+// ---- Fixed-width engine: Montgomery với số word cố định lúc biên dịch (như bai3_fixed.cpp) ----
+// LIMBS là hằng số nên compiler unroll/vector hoá được các vòng lặp trong mul().
+template <int LIMBS>
+struct FixedMontgomery
+{
+    uint32_t N[LIMBS];
+    uint32_t R2[LIMBS];
+    uint32_t n_inv;
+    BigInt modulus;
+
+    // Cùng N ở radix 2^52 cho kernel IFMA, R' = 2^(52 * DIGITS)
+    static const int DIGITS = ((LIMBS * 32 + 51) / 52 + 7) / 8 * 8;
+    bool ifma = false;
+    uint64_t ifmaK0 = 0; // -N^-1 mod 2^52
+    alignas(64) uint64_t ifmaN[DIGITS];
+    alignas(64) uint64_t ifmaR2[DIGITS]; // R'^2 mod N
+
+    explicit FixedMontgomery(const BigInt &mod) : modulus(mod)
+    {
+        for (int i = 0; i < LIMBS; i++)
+            N[i] = mod.a[i];
+        n_inv = BigInt::montgomeryInv32(N[0]);
+        ifma = LIMBS >= IFMA_MIN_LIMBS && g_useIfma;
+
+        // R^2 mod N cho kernel đang dùng (R = 2^(32 * LIMBS) hoặc 2^(52 * DIGITS))
+        int r2Bit = ifma ? 104 * DIGITS : 64 * LIMBS;
+        BigInt R2big;
+        R2big.a.assign(r2Bit / 32 + 1, 0);
+        R2big.a.back() = 1u << (r2Bit % 32);
+        R2big = BigInt::modBig(R2big, mod);
+        for (int i = 0; i < LIMBS; i++)
+            R2[i] = (i < (int)R2big.a.size()) ? R2big.a[i] : 0;
+
+        if (ifma)
+        {
+            toRadix52(ifmaN, N, LIMBS, DIGITS);
+            toRadix52(ifmaR2, R2, LIMBS, DIGITS);
+            uint64_t inv = ifmaN[0];
+            for (int i = 0; i < 6; i++)
+                inv *= 2 - ifmaN[0] * inv;
+            ifmaK0 = (0 - inv) & MASK52;
+        }
+    }
+
+    void mul52(uint64_t *res, const uint64_t *a, const uint64_t *b) const
+    {
+        g_totalCounters.reductions++;
+        ifmaMontMul<DIGITS>(res, a, b, ifmaN, ifmaK0);
+    }
+
+    // res = a * b * R^-1 mod N (CIOS), res được phép trùng a hoặc b
+    void mul(uint32_t *res, const uint32_t *a, const uint32_t *b) const
+    {
+        g_totalCounters.reductions++;
+        uint32_t t[LIMBS + 2] = {0};
+        for (int i = 0; i < LIMBS; i++)
+        {
+            uint64_t carry = 0;
+            for (int j = 0; j < LIMBS; j++)
+            {
+                uint64_t cur = (uint64_t)t[j] + (uint64_t)a[i] * b[j] + carry;
+                t[j] = (uint32_t)cur;
+                carry = cur >> 32;
+            }
+            uint64_t cur = (uint64_t)t[LIMBS] + carry;
+            t[LIMBS] = (uint32_t)cur;
+            t[LIMBS + 1] = (uint32_t)(cur >> 32);
+
+            uint32_t m = t[0] * n_inv;
+            cur = (uint64_t)t[0] + (uint64_t)m * N[0];
+            carry = cur >> 32;
+            for (int j = 1; j < LIMBS; j++)
+            {
+                cur = (uint64_t)t[j] + (uint64_t)m * N[j] + carry;
+                t[j - 1] = (uint32_t)cur;
+                carry = cur >> 32;
+            }
+            cur = (uint64_t)t[LIMBS] + carry;
+            t[LIMBS - 1] = (uint32_t)cur;
+            t[LIMBS] = t[LIMBS + 1] + (uint32_t)(cur >> 32);
+        }
+
+        // trừ N nếu t >= N: tính t - N, giữ lại nếu không mượn
+        uint32_t d[LIMBS];
+        uint64_t borrow = 0;
+        for (int i = 0; i < LIMBS; i++)
+        {
+            uint64_t diff = (uint64_t)t[i] - N[i] - borrow;
+            d[i] = (uint32_t)diff;
+            borrow = (diff >> 63);
+        }
+        const uint32_t *src = (t[LIMBS] || !borrow) ? d : t;
+        for (int i = 0; i < LIMBS; i++)
+            res[i] = src[i];
+    }
+
+    // Như power() nhưng trên kernel IFMA; bảng lũy thừa lẻ cũng nằm trong g_windowTable của thread
+    BigInt powerIfma(const uint32_t *xw, const BigInt &k) const
+    {
+        alignas(64) uint64_t xm[DIGITS], r[DIGITS], one[DIGITS] = {1};
+        toRadix52(xm, xw, LIMBS, DIGITS);
+        mul52(xm, xm, ifmaR2);
+        mul52(r, one, ifmaR2);
+
+        // DIGITS là bội của 8 nên mỗi dòng (8 * DIGITS byte) đúng đầu cache line
+        int w = windowBits(k.bitLength());
+        uint64_t *table = (uint64_t *)g_windowTable.reserve((size_t)2 * DIGITS << (w - 1));
+        copy(xm, xm + DIGITS, table);
+        if (w > 1)
+        {
+            alignas(64) uint64_t x2[DIGITS];
+            g_totalCounters.squarings++;
+            mul52(x2, xm, xm);
+            for (int i = 1; i < (1 << (w - 1)); i++)
+            {
+                g_totalCounters.multiplies++;
+                mul52(table + i * DIGITS, table + (i - 1) * DIGITS, x2);
+            }
+        }
+
+        BigInt::slidingWindow(
+            k, w,
+            [&](uint32_t idx)
+            { copy(table + idx * DIGITS, table + (idx + 1) * DIGITS, r); },
+            [&]()
+            {
+                g_totalCounters.squarings++;
+                mul52(r, r, r);
+            },
+            [&](uint32_t idx)
+            {
+                g_totalCounters.multiplies++;
+                mul52(r, r, table + idx * DIGITS);
+            });
+        mul52(r, r, one);
+
+        BigInt y;
+        y.a.resize(LIMBS);
+        fromRadix52(y.a.data(), r, DIGITS, LIMBS);
+        y.trim();
+        return y;
+    }
+
+    BigInt power(const BigInt &x, const BigInt &k) const
+    {
+        BigInt xr = BigInt::modBig(x, modulus);
+        uint32_t xm[LIMBS] = {0}, r[LIMBS] = {0}, one[LIMBS] = {0};
+        for (size_t i = 0; i < xr.a.size(); i++)
+            xm[i] = xr.a[i];
+        if (ifma)
+            return powerIfma(xm, k);
+        one[0] = 1;
+        mul(xm, xm, R2);
+        mul(r, one, R2);
+
+        // bảng lũy thừa lẻ, LIMBS là bội của 16 nên mỗi dòng đúng đầu cache line
+        int w = windowBits(k.bitLength());
+        uint32_t *table = g_windowTable.reserve((size_t)LIMBS << (w - 1));
+        copy(xm, xm + LIMBS, table);
+        if (w > 1)
+        {
+            uint32_t x2[LIMBS];
+            g_totalCounters.squarings++;
+            mul(x2, xm, xm);
+            for (int i = 1; i < (1 << (w - 1)); i++)
+            {
+                g_totalCounters.multiplies++;
+                mul(table + i * LIMBS, table + (i - 1) * LIMBS, x2);
+            }
+        }
+
+        BigInt::slidingWindow(
+            k, w,
+            [&](uint32_t idx)
+            { copy(table + idx * LIMBS, table + (idx + 1) * LIMBS, r); },
+            [&]()
+            {
+                g_totalCounters.squarings++;
+                mul(r, r, r);
+            },
+            [&](uint32_t idx)
+            {
+                g_totalCounters.multiplies++;
+                mul(r, r, table + idx * LIMBS);
+            });
+        mul(r, r, one);
+
+        BigInt y;
+        y.a.assign(r, r + LIMBS);
+        y.trim();
+        return y;
+    }
+};
+
+// ---- Barrett (số mũ ngắn) ----
+// mu = floor(2^(64n) / N) tính một lần; mỗi phép nhân x = a*b, q = ((x >> 32(n-1)) * mu) >> 32(n+1),
+// r = x - q*N (chỉ cần n+1 word thấp), trừ N thêm vài lần. Không có R^2 hay chuyển miền Montgomery,
+// nên với số mũ ngắn (e = 3, 17, 65537) phần chuẩn bị không lấn át ~17 phép nhân thực sự.
+// Dùng được cho cả N chẵn.
+struct Barrett
+{
+    BigInt modulus;
+    int n;
+    vector<uint32_t> N, mu;           // mu có n+1 word
+    mutable vector<uint32_t> x, q, r; // bộ đệm, không cấp phát trong vòng lặp
+    mutable vector<uint32_t> qn;      // q3 * N (nhánh NTT)
+    mutable NttScratch ntt;           // bộ đệm NTT dùng chung cho cả ba tích của mulModNtt
+
+    explicit Barrett(const BigInt &mod) : modulus(mod), n((int)mod.a.size()), N(mod.a)
+    {
+        // floor((2^(64n) - 1) / N) thay vì floor(2^(64n) / N): luôn vừa n+1 word kể cả khi N = 2^(32(n-1))
+        BigInt pow2, rem;
+        pow2.a.assign(2 * n, 0xFFFFFFFFu);
+        mu = BigInt::divide(pow2, mod, rem).a;
+        mu.resize(n + 1, 0);
+        x.resize(2 * n);
+        q.resize(2 * n + 3);
+        r.resize(n + 1);
+    }
+
+    // r < 4N: trừ N tới khi < N
+    void subtractN() const
+    {
+        while (true)
+        {
+            bool ge = r[n] != 0;
+            if (!ge)
+            {
+                ge = true;
+                for (int i = n - 1; i >= 0; i--)
+                    if (r[i] != N[i])
+                    {
+                        ge = r[i] > N[i];
+                        break;
+                    }
+            }
+            if (!ge)
+                break;
+            uint64_t borrow = 0;
+            for (int i = 0; i <= n; i++)
+            {
+                uint64_t diff = (uint64_t)r[i] - (i < n ? N[i] : 0) - borrow;
+                r[i] = (uint32_t)diff;
+                borrow = diff >> 63;
+            }
+        }
+    }
+
+    // res = a * b mod N, a, b < N, res được phép trùng a hoặc b
+    void mulMod(uint32_t *res, const uint32_t *a, const uint32_t *b) const
+    {
+        g_totalCounters.reductions++;
+        if ((size_t)n >= NTT_MIN_WORDS && mulModNtt(res, a, b))
+            return;
+        fill(x.begin(), x.end(), 0);
+        if (a == b)
+        {
+            // bình phương: tích chéo a[i]*a[j] (i < j) chỉ tính một lần rồi nhân đôi, cộng đường chéo
+            for (int i = 0; i < n; i++)
+            {
+                uint64_t carry = 0;
+                for (int j = i + 1; j < n; j++)
+                {
+                    uint64_t cur = (uint64_t)x[i + j] + (uint64_t)a[i] * a[j] + carry;
+                    x[i + j] = (uint32_t)cur;
+                    carry = cur >> 32;
+                }
+                x[i + n] = (uint32_t)carry;
+            }
+            uint64_t carry = 0;
+            for (int i = 0; i < n; i++)
+            {
+                uint64_t sq = (uint64_t)a[i] * a[i];
+                uint64_t lo = ((uint64_t)x[2 * i] << 1) + (uint32_t)sq + carry;
+                x[2 * i] = (uint32_t)lo;
+                uint64_t hi = ((uint64_t)x[2 * i + 1] << 1) + (sq >> 32) + (lo >> 32);
+                x[2 * i + 1] = (uint32_t)hi;
+                carry = hi >> 32;
+            }
+        }
+        else
+        {
+            for (int i = 0; i < n; i++)
+            {
+                uint64_t carry = 0;
+                for (int j = 0; j < n; j++)
+                {
+                    uint64_t cur = (uint64_t)x[i + j] + (uint64_t)a[i] * b[j] + carry;
+                    x[i + j] = (uint32_t)cur;
+                    carry = cur >> 32;
+                }
+                x[i + n] = (uint32_t)carry;
+            }
+        }
+
+        // q1 = x >> 32(n-1) (n+1 word); q2 = q1 * mu chỉ tính các cột >= n-1, q3 = q2 >> 32(n+1).
+        // Bỏ các cột thấp làm q3 nhỏ hơn thương đúng tối đa vài đơn vị, vòng trừ N ở cuối bù lại.
+        const uint32_t *q1 = x.data() + (n - 1);
+        fill(q.begin(), q.end(), 0);
+        for (int i = 0; i <= n; i++)
+        {
+            uint64_t carry = 0;
+            for (int j = max(0, n - 1 - i); j <= n; j++)
+            {
+                uint64_t cur = (uint64_t)q[i + j] + (uint64_t)q1[i] * mu[j] + carry;
+                q[i + j] = (uint32_t)cur;
+                carry = cur >> 32;
+            }
+            q[i + n + 1] += (uint32_t)carry;
+        }
+        const uint32_t *q3 = q.data() + (n + 1);
+
+        // r = x - q3 * N mod 2^(32(n+1)), chỉ cần tích ở n+1 word thấp
+        for (int i = 0; i <= n; i++)
+            r[i] = x[i];
+        for (int i = 0; i <= n; i++)
+        {
+            uint64_t carry = 0, borrow = 0;
+            for (int j = 0; j < n && i + j <= n; j++)
+            {
+                uint64_t cur = (uint64_t)q3[i] * N[j] + carry;
+                carry = cur >> 32;
+                uint64_t diff = (uint64_t)r[i + j] - (uint32_t)cur - borrow;
+                r[i + j] = (uint32_t)diff;
+                borrow = diff >> 63;
+            }
+            for (int j = i + n; j <= n; j++)
+            {
+                uint64_t diff = (uint64_t)r[j] - carry - borrow;
+                r[j] = (uint32_t)diff;
+                borrow = diff >> 63;
+                carry = 0;
+            }
+        }
+
+        subtractN();
+        copy(r.begin(), r.begin() + n, res);
+    }
+
+    // N rất lớn: ba tích đầy đủ x = a*b, q1*mu, q3*N đều qua NTT, O(n log n) mỗi phép nhân
+    bool mulModNtt(uint32_t *res, const uint32_t *a, const uint32_t *b) const
+    {
+        if (!nttMultiply(x, a, n, b, n, ntt) || !nttMultiply(q, x.data() + (n - 1), n + 1, mu.data(), n + 1, ntt))
+            return false;
+        const uint32_t *q3 = q.data() + (n + 1);
+        if (!nttMultiply(qn, q3, n + 1, N.data(), n, ntt))
+            return false;
+        uint64_t borrow = 0;
+        for (int i = 0; i <= n; i++)
+        {
+            uint64_t diff = (uint64_t)x[i] - qn[i] - borrow;
+            r[i] = (uint32_t)diff;
+            borrow = diff >> 63;
+        }
+        subtractN();
+        copy(r.begin(), r.begin() + n, res);
+        return true;
+    }
+
+    // cửa sổ trượt trái sang phải; số mũ ngắn (<= 23 bit) thì w = 1, tức nhị phân, không tốn bảng
+    BigInt power(const BigInt &base, const BigInt &k) const
+    {
+        if (k.isZero())
+            return BigInt::modBig(BigInt(1), modulus);
+        BigInt xr = BigInt::modBig(base, modulus);
+        vector<uint32_t> xb(n, 0);
+        copy(xr.a.begin(), xr.a.end(), xb.begin());
+
+        int w = windowBits(k.bitLength());
+        vector<vector<uint32_t>> table(1 << (w - 1), xb);
+        if (w > 1)
+        {
+            vector<uint32_t> x2(n);
+            g_totalCounters.squarings++;
+            mulMod(x2.data(), xb.data(), xb.data());
+            for (size_t i = 1; i < table.size(); i++)
+            {
+                g_totalCounters.multiplies++;
+                mulMod(table[i].data(), table[i - 1].data(), x2.data());
+            }
+        }
+
+        vector<uint32_t> acc(n);
+        BigInt::slidingWindow(
+            k, w,
+            [&](uint32_t idx)
+            { acc = table[idx]; },
+            [&]()
+            {
+                g_totalCounters.squarings++;
+                mulMod(acc.data(), acc.data(), acc.data());
+            },
+            [&](uint32_t idx)
+            {
+                g_totalCounters.multiplies++;
+                mulMod(acc.data(), acc.data(), table[idx].data());
+            });
+
+        BigInt y;
+        y.a = acc;
+        y.trim();
+        return y;
+    }
+};
+
+// ---- N chẵn: N = 2^s * m ----
+// Lũy thừa mod m lẻ đi engine Montgomery, mod 2^s chỉ cần nhân cắt cụt (giữ s bit thấp),
+// ghép bằng CRT: y = y1 + m * ((y2 - y1) * m^-1 mod 2^s).
+BigInt modexp(const BigInt &N, const BigInt &k, const BigInt &x);
+
+// a * b mod 2^(32 * words), a và b đúng words word: chỉ tính các tích i + j < words
+vector<uint32_t> truncMul(const vector<uint32_t> &a, const vector<uint32_t> &b, int words)
+{
+    g_totalCounters.multiplies++;
+    vector<uint32_t> r(words, 0);
+    for (int i = 0; i < words; i++)
+    {
+        uint64_t carry = 0;
+        for (int j = 0; i + j < words; j++)
+        {
+            uint64_t cur = (uint64_t)r[i + j] + (uint64_t)a[i] * b[j] + carry;
+            r[i + j] = (uint32_t)cur;
+            carry = cur >> 32;
+        }
+    }
+    return r;
+}
+
+// giữ s bit thấp của v (v có đúng ceil(s/32) word)
+void maskBits(vector<uint32_t> &v, int s)
+{
+    if (s % 32)
+        v.back() &= (1u << (s % 32)) - 1;
+}
+
+vector<uint32_t> lowWords(const BigInt &A, int words)
+{
+    vector<uint32_t> r(words, 0);
+    for (int i = 0; i < words && i < (int)A.a.size(); i++)
+        r[i] = A.a[i];
+    return r;
+}
+
+// x^k mod 2^s bằng cửa sổ trượt trên phép nhân cắt cụt
+vector<uint32_t> powerMod2k(const BigInt &x, const BigInt &k, int s)
+{
+    int words = (s + 31) / 32;
+    vector<uint32_t> one(words, 0);
+    one[0] = 1;
+    vector<uint32_t> xw = lowWords(x, words);
+    maskBits(xw, s);
+
+    // x chẵn: x^k chia hết cho 2^k, đủ để bằng 0 khi k >= s
+    if (!(xw[0] & 1) && k.bitLength() > 0 && (k.bitLength() > 31 || (int)k.a[0] >= s))
+        return vector<uint32_t>(words, 0);
+
+    int w = windowBits(k.bitLength());
+    vector<vector<uint32_t>> table(1 << (w - 1));
+    table[0] = xw;
+    if (w > 1)
+    {
+        vector<uint32_t> x2 = truncMul(xw, xw, words);
+        for (size_t i = 1; i < table.size(); i++)
+            table[i] = truncMul(table[i - 1], x2, words);
+    }
+
+    vector<uint32_t> r = one;
+    BigInt::slidingWindow(
+        k, w,
+        [&](uint32_t idx)
+        { r = table[idx]; },
+        [&]()
+        {
+            g_totalCounters.squarings++;
+            r = truncMul(r, r, words);
+        },
+        [&](uint32_t idx)
+        { r = truncMul(r, table[idx], words); });
+    maskBits(r, s);
+    return r;
+}
+
+// m^-1 mod 2^(32 * words) với m lẻ: Newton/Hensel, mỗi vòng gấp đôi số bit đúng bắt đầu từ 32
+vector<uint32_t> inverseMod2k(const BigInt &m, int words)
+{
+    vector<uint32_t> mw = lowWords(m, words);
+    vector<uint32_t> inv(words, 0);
+    inv[0] = 0u - BigInt::montgomeryInv32(mw[0]);
+    for (int bits = 32; bits < 32 * words; bits *= 2)
+    {
+        // inv = inv * (2 - m * inv)
+        vector<uint32_t> t = truncMul(mw, inv, words);
+        uint64_t borrow = 0;
+        for (int i = 0; i < words; i++)
+        {
+            uint64_t diff = (uint64_t)(i == 0 ? 2 : 0) - t[i] - borrow;
+            t[i] = (uint32_t)diff;
+            borrow = diff >> 63;
+        }
+        inv = truncMul(inv, t, words);
+    }
+    return inv;
+}
+
+BigInt modexpEven(const BigInt &N, const BigInt &k, const BigInt &x)
+{
+    int s = 0;
+    while (!N.bit(s))
+        s++;
+    BigInt m = N;
+    for (int i = 0; i < s; i++)
+        BigInt::shiftRight1(m);
+    int words = (s + 31) / 32;
+
+    vector<uint32_t> y2 = powerMod2k(x, k, s);
+    BAI3_TRACE(1, "modexpEven() s=" << s << " m_bits=" << m.bitLength());
+    if (m.bitLength() == 1) // N = 2^s
+    {
+        BigInt y;
+        y.a = y2;
+        y.trim();
+        return y;
+    }
+
+    BigInt y1 = modexp(m, k, x);
+    vector<uint32_t> diff = lowWords(y1, words);
+    uint64_t borrow = 0;
+    for (int i = 0; i < words; i++)
+    {
+        uint64_t d = (uint64_t)y2[i] - diff[i] - borrow;
+        diff[i] = (uint32_t)d;
+        borrow = d >> 63;
+    }
+    BigInt h;
+    h.a = truncMul(diff, inverseMod2k(m, words), words);
+    maskBits(h.a, s);
+    h.trim();
+    return BigInt::add(y1, BigInt::multiply(m, h));
+}
+
+// ---- Dispatcher ----
+enum Engine
+{
+    ENGINE_NATIVE,
+    ENGINE_FIXED,
+    ENGINE_DYNAMIC,
+    ENGINE_EVEN_CRT,
+    ENGINE_SHORT_EXP,
+    ENGINE_NTT,
+    ENGINE_COUNT
+};
+
+const char *engineName(int e)
+{
+    static const char *names[ENGINE_COUNT] = {"native-64", "fixed-montgomery", "dynamic-montgomery", "even-crt", "barrett-short-exp", "barrett-ntt"};
+    return names[e];
+}
+
+// Số mũ ngắn đi Barrett (bỏ qua R^2 và chuyển miền Montgomery). Đo trên máy dev: từ 1024 bit trở lên
+// Barrett hơn hoặc ngang Montgomery tới e = 65537 (17 bit), N nhỏ hơn thì chỉ thắng với e vài bit;
+// số mũ dài hơn thì Montgomery cửa sổ trượt nhanh hơn.
+bool useShortExp(const BigInt &N, const BigInt &k)
+{
+    return k.bitLength() <= (N.bitLength() >= 1024 ? 17 : 5);
+}
+
+// N từ 2048 word (65536 bit) trở lên: Barrett với tích NTT nhanh hơn Montgomery bậc hai (đo trên máy dev:
+// 2048 word nhanh ~2.4 lần, 8192 word ~8 lần). Dùng được cả N chẵn.
+const size_t NTT_MODEXP_MIN_WORDS = 2048;
+
+thread_local uint64_t g_engineCalls[ENGINE_COUNT] = {0};
+thread_local uint64_t g_engineCycles[ENGINE_COUNT] = {0};
+
+// Engine mà modexp() sẽ chọn cho modulus N và số mũ k
+Engine selectEngine(const BigInt &N, const BigInt &k)
+{
+    if (N.bitLength() <= 64)
+        return ENGINE_NATIVE;
+    if (useShortExp(N, k))
+        return ENGINE_SHORT_EXP;
+    if (N.a.size() >= NTT_MODEXP_MIN_WORDS)
+        return ENGINE_NTT;
+    if (!(N.a[0] & 1))
+        return ENGINE_EVEN_CRT;
+    switch (N.a.size())
+    {
+    case 16:  // 512 bit
+    case 32:  // 1024 bit
+    case 64:  // 2048 bit
+    case 96:  // 3072 bit
+    case 128: // 4096 bit
+        return ENGINE_FIXED;
+    default:
+        return ENGINE_DYNAMIC;
+    }
+}
+
+// y = x^k mod N, chọn engine nhanh nhất còn đúng theo kích thước và tính chẵn lẻ của N
+BigInt modexp(const BigInt &N, const BigInt &k, const BigInt &x)
+{
+    if (N.isZero())
+        throw runtime_error("Modulo by zero");
+
+    CallScope scope;
+    Engine engine = selectEngine(N, k);
+    uint64_t start = readCycles();
+    BAI3_TRACE(1, "modexp() engine=" << engineName(engine) << " N_bits=" << N.bitLength());
+
+    BigInt y;
+    switch (engine)
+    {
+    case ENGINE_NATIVE:
+    {
+        uint64_t n = toU64(N);
+        y = BigInt(nativeModPow(toU64(BigInt::modBig(x, N)), k, n));
+        break;
+    }
+    case ENGINE_FIXED:
+        switch (N.a.size())
+        {
+        case 16:
+            y = FixedMontgomery<16>(N).power(x, k);
+            break;
+        case 32:
+            y = FixedMontgomery<32>(N).power(x, k);
+            break;
+        case 64:
+            y = FixedMontgomery<64>(N).power(x, k);
+            break;
+        case 96:
+            y = FixedMontgomery<96>(N).power(x, k);
+            break;
+        default:
+            y = FixedMontgomery<128>(N).power(x, k);
+            break;
+        }
+        break;
+    case ENGINE_DYNAMIC:
+        y = BigInt::montPower(x, k, BigInt::montInit(N));
+        break;
+    case ENGINE_SHORT_EXP:
+    case ENGINE_NTT:
+        y = Barrett(N).power(x, k);
+        break;
+    default:
+        y = modexpEven(N, k, x);
+        break;
+    }
+
+    g_engineCalls[engine]++;
+    g_engineCycles[engine] += readCycles() - start;
+    return y;
+}
+
+// ---- CRT (khi biết p, q) ----
+// Nghịch đảo a mod m bằng Euclid mở rộng, hệ số giữ trong [0, m)
+BigInt modInverse(const BigInt &a, const BigInt &m)
+{
+    BigInt r0 = m, r1 = BigInt::modBig(a, m);
+    BigInt t0(0), t1(1);
+    while (!r1.isZero())
+    {
+        BigInt r2;
+        BigInt q = BigInt::divide(r0, r1, r2);
+        BigInt qt = BigInt::modBig(BigInt::multiply(q, t1), m);
+        BigInt t2 = BigInt::compare(t0, qt) >= 0 ? BigInt::subtract(t0, qt) : BigInt::subtract(BigInt::add(t0, m), qt);
+        r0 = r1;
+        r1 = r2;
+        t0 = t1;
+        t1 = t2;
+    }
+    if (BigInt::compare(r0, BigInt(1)) != 0)
+        throw runtime_error("modInverse: not invertible");
+    return t0;
+}
+
+// Khóa riêng dạng CRT: N = p*q, dP = k mod (p-1), dQ = k mod (q-1), qInv = q^-1 mod p
+struct CrtKey
+{
+    BigInt p, q, dP, dQ, qInv;
+
+    // Từ p, q và số mũ k. Dùng ((k-1) mod (p-1)) + 1 thay vì k mod (p-1)
+    // để x chia hết cho p vẫn cho 0 chứ không phải x^0 = 1.
+    static CrtKey fromFactors(const BigInt &p, const BigInt &q, const BigInt &k)
+    {
+        CrtKey key;
+        key.p = p;
+        key.q = q;
+        BigInt km1 = BigInt::subtract(k, BigInt(1));
+        key.dP = BigInt::add(BigInt::modBig(km1, BigInt::subtract(p, BigInt(1))), BigInt(1));
+        key.dQ = BigInt::add(BigInt::modBig(km1, BigInt::subtract(q, BigInt(1))), BigInt(1));
+        key.qInv = modInverse(q, p);
+        return key;
+    }
+};
+
+// y = x^d mod pq: hai lũy thừa nửa kích thước (mod p qua std::async, mod q trên thread gọi),
+// ghép lại bằng Garner: h = qInv * (mp - mq) mod p, y = mq + h * q.
+// Máy một nhân, hoặc không tạo được thread, thì chạy tuần tự (vẫn nhanh ~3-4 lần so với lũy thừa mod N).
+// Lỗi ở nửa mod p được future.get() ném lại trên thread gọi.
+BigInt modexpCrt(const BigInt &x, const CrtKey &key)
+{
+    CallScope scope;
+    BAI3_TRACE(1, "modexpCrt() p_bits=" << key.p.bitLength() << " q_bits=" << key.q.bitLength());
+
+    BigInt mp, mq;
+    auto halfP = [&]()
+    { return modexp(key.p, key.dP, BigInt::modBig(x, key.p)); };
+    future<pair<BigInt, OpCounters>> pending;
+    if (thread::hardware_concurrency() > 1)
+    {
+        try
+        {
+            // bộ đếm là thread_local: trả phần của thread phụ về cùng kết quả
+            pending = async(launch::async, [&]()
+                            {
+                OpCounters before = g_totalCounters;
+                BigInt r = halfP();
+                OpCounters worker = g_totalCounters - before;
+                worker.calls = 0;
+                worker.cycles = 0;
+                return make_pair(r, worker); });
+        }
+        catch (const system_error &)
+        {
+        }
+    }
+    // nếu nửa mod q ném lỗi, hủy future (chờ nửa mod p xong) rồi lỗi đi tiếp
+    mq = modexp(key.q, key.dQ, BigInt::modBig(x, key.q));
+    if (pending.valid())
+    {
+        pair<BigInt, OpCounters> r = pending.get();
+        mp = r.first;
+        g_totalCounters += r.second;
+    }
+    else
+        mp = halfP();
+
+    // Garner
+    BigInt mqp = BigInt::modBig(mq, key.p);
+    BigInt diff = BigInt::compare(mp, mqp) >= 0 ? BigInt::subtract(mp, mqp) : BigInt::subtract(BigInt::add(mp, key.p), mqp);
+    BigInt h = BigInt::modBig(BigInt::multiply(key.qInv, diff), key.p);
+    return BigInt::add(mq, BigInt::multiply(h, key.q));
+}
+
+// ---- Latency mode: tách số mũ ----
+// k = sum k_i * 2^(i*m), y = prod (x^(2^(i*m)))^(k_i). Thread gọi chạy chuỗi bình phương sinh các cơ số
+// b_i = x^(2^(i*m)); đoạn i được giao cho một worker rảnh trong pool ngay khi có b_i, mỗi worker nhân dồn
+// các đoạn nó làm vào tích riêng. Đoạn cuối bắt đầu sau (t-1)m bình phương nên độ trễ ~ L bình phương
+// + m/(w+1) phép nhân + số worker phép ghép, so với L(1 + 1/(w+1)) khi chạy tuần tự.
+// Tổng công gần gấp đôi; bình phương liên tiếp không song song được nên lợi tối đa ~1/(w+1) (~14% ở w = 6).
+
+// Số đoạn t theo độ dài số mũ: ~ sqrt(L/(w+1)) cân phần đuôi m/(w+1) với các phép ghép, và mỗi đoạn
+// dài ít nhất 2^(w+1) bit để bảng 2^(w-1) lũy thừa lẻ của đoạn không lấn át phần bình phương.
+// Theo số thread: một đoạn mất m(1 + 1/(w+1)) trong khi chuỗi sinh cơ số mới sau m bình phương, nên
+// cần ít nhất 2 worker ngoài thread gọi; ít hơn thì t = 1 (chạy tuần tự). Pool có min(threads - 1, t)
+// worker, thread thừa để dư cho lúc worker bị trễ.
+int latencySplit(int expBits, unsigned threads)
+{
+    if (threads < 3 || expBits < 256)
+        return 1;
+    int w = windowBits(expBits);
+    int t = (int)(sqrt((double)expBits / (w + 1)) + 0.5);
+    return max(1, min(t, expBits >> (w + 1)));
+}
+
+// y = x^k mod N với độ trễ thấp cho một lần gọi lớn; N chẵn hoặc không đáng tách thì đi modexp()
+BigInt modexpSplit(const BigInt &N, const BigInt &k, const BigInt &x, unsigned threads = 0)
+{
+    if (threads == 0)
+        threads = max(1u, thread::hardware_concurrency());
+    int L = k.bitLength();
+    int t = latencySplit(L, threads);
+    if (t <= 1 || N.bitLength() <= 64 || !(N.a[0] & 1))
+        return modexp(N, k, x);
+
+    CallScope scope;
+    BAI3_TRACE(1, "modexpSplit() chunks=" << t << " N_bits=" << N.bitLength());
+    BigInt::MontgomeryCtx ctx = BigInt::montInit(N);
+    size_t n = ctx.N.size();
+    int m = (L + t - 1) / t;
+    int poolSize = min((int)threads - 1, t);
+
+    vector<BigInt> chunk(t);
+    for (int i = 0; i < t; i++)
+    {
+        int lo = i * m, hi = min(L, lo + m);
+        chunk[i].a.assign((m + 31) / 32, 0);
+        for (int b = lo; b < hi; b++)
+            if (k.bit(b))
+                chunk[i].a[(b - lo) / 32] |= 1u << ((b - lo) % 32);
+        chunk[i].trim();
+    }
+
+    vector<vector<uint32_t>> bases(t), acc(poolSize);
+    bases[0] = BigInt::modBig(x, N).a;
+    bases[0].resize(n, 0);
+    BigInt::montMul(bases[0], bases[0], ctx.R2, ctx);
+
+    // ready: số cơ số đã có; next: đoạn kế tiếp chưa giao; stop: thread gọi lỗi, worker bỏ phần còn lại
+    mutex mu;
+    condition_variable cv;
+    int ready = 1, next = 0;
+    bool stop = false;
+    exception_ptr error;
+    vector<OpCounters> workerCounters(poolSize);
+    vector<thread> workers;
+
+    auto work = [&](int id)
+    {
+        try
+        {
+            vector<uint32_t> part;
+            while (true)
+            {
+                int i;
+                {
+                    unique_lock<mutex> lock(mu);
+                    cv.wait(lock, [&]()
+                            { return stop || next >= t || next < ready; });
+                    if (stop || next >= t)
+                        break;
+                    i = next++;
+                }
+                BigInt::montPowerMont(part, bases[i], chunk[i], ctx);
+                if (acc[id].empty())
+                    acc[id].swap(part);
+                else
+                {
+                    g_totalCounters.multiplies++;
+                    BigInt::montMulRaw(acc[id].data(), acc[id].data(), part.data(), ctx);
+                }
+            }
+        }
+        catch (...)
+        {
+            lock_guard<mutex> lock(mu);
+            if (!error)
+                error = current_exception();
+            stop = true;
+            cv.notify_all();
+        }
+        workerCounters[id] = g_totalCounters;
+    };
+
+    // lỗi ở thread gọi (kể cả lúc tạo thread): dừng pool, join các thread đã chạy rồi mới ném tiếp
+    auto joinAll = [&]()
+    {
+        for (thread &w : workers)
+            if (w.joinable())
+                w.join();
+    };
+    try
+    {
+        for (int id = 0; id < poolSize; id++)
+            workers.emplace_back(work, id);
+
+        // chuỗi bình phương trên thread gọi
+        vector<uint32_t> cur = bases[0];
+        for (int i = 1; i < t; i++)
+        {
+            for (int j = 0; j < m; j++)
+            {
+                g_totalCounters.squarings++;
+                BigInt::montMulRaw(cur.data(), cur.data(), cur.data(), ctx);
+            }
+            {
+                lock_guard<mutex> lock(mu);
+                if (stop)
+                    break;
+                bases[i] = cur;
+                ready = i + 1;
+            }
+            cv.notify_all();
+        }
+    }
+    catch (...)
+    {
+        {
+            lock_guard<mutex> lock(mu);
+            stop = true;
+        }
+        cv.notify_all();
+        joinAll();
+        throw;
+    }
+    joinAll();
+    if (error)
+        rethrow_exception(error);
+
+    // bộ đếm thread_local của worker cộng vào thread gọi, rồi ghép tích của từng worker
+    vector<uint32_t> result;
+    for (int id = 0; id < poolSize; id++)
+    {
+        workerCounters[id].calls = 0;
+        workerCounters[id].cycles = 0;
+        g_totalCounters += workerCounters[id];
+        if (acc[id].empty())
+            continue;
+        if (result.empty())
+            result.swap(acc[id]);
+        else
+        {
+            g_totalCounters.multiplies++;
+            BigInt::montMulRaw(result.data(), result.data(), acc[id].data(), ctx);
+        }
+    }
+
+    vector<uint32_t> one(n, 0);
+    one[0] = 1;
+    BigInt y;
+    BigInt::montMul(y.a, result, one, ctx);
+    y.trim();
+    return y;
+}
+
+// ---- Bình phương lặp: y = x^(2^t) mod N (time-lock puzzle, VDF) ----
+// Không dựng số mũ 2^t: N lẻ thì cả chuỗi nằm trong miền Montgomery với kernel bình phương riêng,
+// chỉ ra khỏi miền ở checkpoint và ở cuối. N chẵn hoặc từ NTT_MODEXP_MIN_WORDS word thì đi Barrett.
+struct RepeatedSquareStats
+{
+    uint64_t squarings = 0;
+    double seconds = 0;
+
+    double perSecond() const { return seconds > 0 ? squarings / seconds : 0; }
+};
+
+// every > 0: gọi checkpoint(i, x^(2^i) mod N) sau mỗi every bước (checkpoint rỗng thì không có checkpoint)
+typedef function<void(uint64_t, const BigInt &)> SquareCheckpoint;
+
+BigInt repeatedSquare(const BigInt &x, uint64_t t, const BigInt &N, uint64_t every = 0,
+                      const SquareCheckpoint &checkpoint = nullptr, RepeatedSquareStats *stats = nullptr)
+{
+    if (N.isZero())
+        throw runtime_error("Modulo by zero");
+
+    CallScope scope;
+    BAI3_TRACE(1, "repeatedSquare() t=" << t << " N_bits=" << N.bitLength());
+    auto start = chrono::steady_clock::now();
+    size_t n = N.a.size();
+    if (!checkpoint)
+        every = 0; // không gọi function rỗng (bad_function_call), cũng không phải tính các giá trị checkpoint
+    uint64_t untilCheckpoint = every;
+    BigInt y;
+
+    if ((N.a[0] & 1) && n < NTT_MODEXP_MIN_WORDS && BigInt::compare(N, BigInt(1)) > 0)
+    {
+        BigInt::MontgomeryCtx ctx = BigInt::montInit(N);
+        vector<uint32_t> cur = BigInt::modBig(x, N).a, one(n, 0), scratch(2 * n + 1);
+        cur.resize(n, 0);
+        one[0] = 1;
+        BigInt::montMul(cur, cur, ctx.R2, ctx);
+        for (uint64_t i = 1; i <= t; i++)
+        {
+            g_totalCounters.squarings++;
+            BigInt::montSqrRaw(cur.data(), cur.data(), ctx, scratch.data());
+            if (every && --untilCheckpoint == 0)
+            {
+                untilCheckpoint = every;
+                BigInt v;
+                BigInt::montMul(v.a, cur, one, ctx);
+                v.trim();
+                checkpoint(i, v);
+            }
+        }
+        BigInt::montMul(y.a, cur, one, ctx);
+    }
+    else
+    {
+        Barrett br(N);
+        vector<uint32_t> cur = BigInt::modBig(x, N).a;
+        cur.resize(n, 0);
+        for (uint64_t i = 1; i <= t; i++)
+        {
+            g_totalCounters.squarings++;
+            br.mulMod(cur.data(), cur.data(), cur.data());
+            if (every && --untilCheckpoint == 0)
+            {
+                untilCheckpoint = every;
+                BigInt v;
+                v.a = cur;
+                v.trim();
+                checkpoint(i, v);
+            }
+        }
+        y.a = cur;
+    }
+    y.trim();
+
+    if (stats)
+    {
+        stats->squarings = t;
+        stats->seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    }
+    return y;
+}
+
+// fd và vùng mmap của file checkpoint, đóng/giải phóng cả khi repeatedSquare ném lỗi
+struct MappedFile
+{
+    int fd = -1;
+    void *map = nullptr;
+    size_t bytes = 0;
+
+    MappedFile() = default;
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    ~MappedFile()
+    {
+        if (map)
+            munmap(map, bytes);
+        if (fd >= 0)
+            close(fd);
+    }
+};
+
+// Checkpoint ra file ánh xạ bộ nhớ: bản ghi j (0-based) là x^(2^((j+1)*every)) mod N,
+// đúng n word 32 bit little-endian với n = số word của N. File có floor(t / every) bản ghi.
+BigInt repeatedSquareToFile(const BigInt &x, uint64_t t, const BigInt &N, uint64_t every, const string &path,
+                            RepeatedSquareStats *stats = nullptr)
+{
+    if (every == 0)
+        return repeatedSquare(x, t, N, 0, nullptr, stats);
+
+    size_t n = N.a.size();
+    MappedFile file;
+    file.fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (file.fd < 0)
+        throw runtime_error("Không mở được file checkpoint " + path);
+    size_t bytes = (size_t)(t / every) * n * sizeof(uint32_t);
+    if (bytes)
+    {
+        if (ftruncate(file.fd, (off_t)bytes) != 0)
+            throw runtime_error("Không cấp được " + to_string(bytes) + " byte cho " + path);
+        void *p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, file.fd, 0);
+        if (p == MAP_FAILED)
+            throw runtime_error("mmap thất bại: " + path);
+        file.map = p;
+        file.bytes = bytes;
+    }
+
+    uint32_t *map = (uint32_t *)file.map;
+    return repeatedSquare(x, t, N, every, [&](uint64_t i, const BigInt &v)
+                          {
+        uint32_t *rec = map + (i / every - 1) * n;
+        fill(rec, rec + n, 0);
+        copy(v.a.begin(), v.a.end(), rec); },
+                          stats);
+}
+
+// File test ghi hex đảo ngược theo từng ký tự (ký tự đầu là nibble thấp nhất)
+string toBigEndianHex(const string &littleHex)
+{
+    string s = littleHex;
+    reverse(s.begin(), s.end());
+    return s;
+}
+
+string toLittleEndianHex(const string &bigHex)
+{
+    string s = bigHex;
+    reverse(s.begin(), s.end());
+    return s;
+}
+
+BigInt randomBigInt(mt19937 &rng, int bits)
+{
+    BigInt r;
+    r.a.assign((bits + 31) / 32, 0);
+    for (auto &w : r.a)
+        w = rng();
+    if (bits % 32)
+        r.a.back() &= (1u << (bits % 32)) - 1;
+    r.a.back() |= 1u << ((bits - 1) % 32);
+    r.trim();
+    return r;
+}
+
+template <class F>
+double timeMs(int reps, F f)
+{
+    auto start = chrono::high_resolution_clock::now();
+    for (int i = 0; i < reps; i++)
+        f();
+    auto end = chrono::high_resolution_clock::now();
+    return chrono::duration<double, milli>(end - start).count() / reps;
+}
+
+// Phép chia cũ (mỗi chữ số thương tìm bằng binary search), chỉ để runBenchmark so với Algorithm D;
+// không thuộc BigInt nên chương trình chỉ có một phép chia là BigInt::divide
+static BigInt divideBinarySearch(const BigInt &A, const BigInt &B, BigInt &R)
+{
+    if (BigInt::compare(A, B) < 0)
+    {
+        R = A;
+        return BigInt(0);
+    }
+    if (B.isZero())
+        throw runtime_error("Division by zero");
+
+    BigInt Q;
+    R = BigInt(0);
+    Q.a.resize(A.a.size());
+    for (int i = (int)A.a.size() - 1; i >= 0; i--)
+    {
+        R = BigInt::multiply(R, BigInt(BigInt::BASE));
+        if (R.a.empty())
+            R.a.push_back(0);
+        R.a[0] = A.a[i];
+        R.trim();
+
+        uint32_t left = 0, right = BigInt::BASE - 1;
+        uint32_t x = 0;
+        while (left <= right)
+        {
+            uint32_t mid = left + (right - left) / 2;
+            BigInt t = BigInt::multiply(B, BigInt(mid));
+            int cmp = BigInt::compare(t, R);
+            if (cmp <= 0)
+            {
+                x = mid;
+                left = mid + 1;
+            }
+            else
+            {
+                right = mid - 1;
+            }
+        }
+        Q.a[i] = x;
+        R = BigInt::subtract(R, BigInt::multiply(B, BigInt(x)));
+    }
+    Q.trim();
+    return Q;
+}
+
+// So sánh Algorithm D với bản binary search cũ: modBig (2n bit / n bit) và power (exp 64 bit)
+void runBenchmark()
+{
+    mt19937 rng(12345);
+    int sizes[] = {512, 1024, 2048, 4096};
+
+    cout << "bits\tmodBig old(ms)\tmodBig new(ms)\tpower old(ms)\tpower new(ms)" << endl;
+    for (int bits : sizes)
+    {
+        BigInt N = randomBigInt(rng, bits);
+        BigInt A = randomBigInt(rng, 2 * bits);
+        BigInt x = randomBigInt(rng, bits - 1);
+        BigInt k = randomBigInt(rng, 64);
+
+        BigInt R;
+        double modOld = timeMs(3, [&]()
+                               { divideBinarySearch(A, N, R); });
+        double modNew = timeMs(200, [&]()
+                               { BigInt::modBig(A, N); });
+
+        // power với phép chia cũ
+        double powOld = timeMs(1, [&]()
+                               {
+            BigInt result(1), base = x, exp = k, rem;
+            while (!exp.isZero())
+            {
+                if (exp.a[0] & 1)
+                {
+                    divideBinarySearch(BigInt::multiply(result, base), N, rem);
+                    result = rem;
+                }
+                BigInt::shiftRight1(exp);
+                divideBinarySearch(BigInt::multiply(base, base), N, rem);
+                base = rem;
+            } });
+        double powNew = timeMs(5, [&]()
+                               { BigInt::power(x, k, N); });
+
+        cout << bits << "\t" << modOld << "\t" << modNew << "\t" << powOld << "\t" << powNew << endl;
+    }
+
+    // modexp(): engine được chọn cho từng kích thước, so với engine động (Montgomery / chia)
+    int modexpBits[] = {32, 64, 256, 512, 768, 1024, 1536, 2048, 3072, 4096};
+    cout << "\nbits\t" << left << setw(20) << "engine" << "modexp(ms)\tdynamic(ms)" << endl;
+    for (int bits : modexpBits)
+    {
+        BigInt N = randomBigInt(rng, bits);
+        N.a[0] |= 1;
+        BigInt x = randomBigInt(rng, bits - 1);
+        BigInt k = randomBigInt(rng, bits);
+        int reps = max(1, 4096 / bits);
+
+        double viaModexp = timeMs(reps, [&]()
+                                  { modexp(N, k, x); });
+        double viaPower = timeMs(reps, [&]()
+                                 { BigInt::power(x, k, N); });
+        cout << bits << "\t" << setw(20) << engineName(selectEngine(N, k)) << viaModexp << "\t" << viaPower << endl;
+    }
+
+    // Số phép nhân mỗi lần lũy thừa với cửa sổ trượt (nhị phân thường cần ~bits/2)
+    cout << "\nexp bits\twindow\tsquarings\tmultiplies\tbinary multiplies" << endl;
+    int expBits[] = {17, 64, 256, 1024, 2048, 4096};
+    BigInt Nw = randomBigInt(rng, 1024);
+    Nw.a[0] |= 1;
+    BigInt xw = randomBigInt(rng, 1000);
+    for (int bits : expBits)
+    {
+        BigInt k = randomBigInt(rng, bits);
+        int ones = 0;
+        for (int i = 0; i < bits; i++)
+            ones += k.bit(i);
+        modexp(Nw, k, xw);
+        const OpCounters &c = lastCallCounters();
+        cout << bits << "\t\t" << windowBits(bits) << "\t" << c.squarings << "\t\t" << c.multiplies << "\t\t" << ones - 1 << endl;
+    }
+
+    // N chẵn (N = 2^s * m): CRT so với cửa sổ trượt dựa trên phép chia
+    cout << "\nbits\teven-crt(ms)\tdivision(ms)" << endl;
+    for (int bits : {512, 1024, 2048})
+    {
+        BigInt N = randomBigInt(rng, bits);
+        N.a[0] &= ~1u;
+        BigInt x = randomBigInt(rng, bits - 1);
+        BigInt k = randomBigInt(rng, bits);
+        int reps = max(1, 2048 / bits);
+        double viaCrt = timeMs(reps, [&]()
+                               { modexp(N, k, x); });
+        double viaDivision = timeMs(reps, [&]()
+                                    { BigInt::power(x, k, N); });
+        cout << bits << "\t" << viaCrt << "\t\t" << viaDivision << endl;
+    }
+
+    // Số mũ công khai ngắn ở 2048 bit: Barrett (modexp tự chọn) so với Montgomery cỡ cố định
+    cout << "\ne\tbarrett(verify/s)\tmontgomery(verify/s)" << endl;
+    BigInt Nv = randomBigInt(rng, 2048);
+    Nv.a[0] |= 1;
+    BigInt sig = randomBigInt(rng, 2047);
+    uint64_t publicExps[] = {3, 17, 65537};
+    for (uint64_t e : publicExps)
+    {
+        BigInt k(e);
+        double viaBarrett = timeMs(200, [&]()
+                                   { modexp(Nv, k, sig); });
+        double viaMont = timeMs(200, [&]()
+                                { FixedMontgomery<64>(Nv).power(sig, k); });
+        cout << e << "\t" << fixed << setprecision(0) << 1000 / viaBarrett << "\t\t\t" << 1000 / viaMont << defaultfloat << setprecision(6) << endl;
+    }
+
+    // FixedMontgomery: kernel IFMA radix 2^52 so với kernel 32 bit (cùng N, k đủ dài)
+    if (g_useIfma)
+    {
+        mt19937 rngIfma(52); // rng riêng: các mục sau vẫn thấy cùng dãy số như khi không có IFMA
+        cout << "\nbits\tscalar(ms)\tifma(ms)" << endl;
+        for (int bits : {2048, 3072, 4096})
+        {
+            BigInt N = randomBigInt(rngIfma, bits);
+            N.a[0] |= 1;
+            BigInt x = randomBigInt(rngIfma, bits - 1);
+            BigInt k = randomBigInt(rngIfma, bits);
+            BigInt viaScalar, viaIfma;
+            g_useIfma = false;
+            double scalar = timeMs(2, [&]()
+                                   { viaScalar = modexp(N, k, x); });
+            g_useIfma = true;
+            double ifma = timeMs(2, [&]()
+                                 { viaIfma = modexp(N, k, x); });
+            cout << bits << "\t" << scalar << "\t\t" << ifma << (BigInt::compare(viaScalar, viaIfma) == 0 ? "" : "\tMISMATCH") << endl;
+        }
+    }
+
+    // CRT: hai lũy thừa nửa kích thước so với một lũy thừa đủ kích thước (p, q chỉ cần lẻ để đo thời gian)
+    cout << "\nbits\tfull(ms)\tcrt(ms)" << endl;
+    int crtBits[] = {1024, 2048, 4096};
+    for (int bits : crtBits)
+    {
+        BigInt p = randomBigInt(rng, bits / 2), q = randomBigInt(rng, bits / 2);
+        p.a[0] |= 1;
+        q.a[0] |= 1;
+        BigInt N = BigInt::multiply(p, q);
+        BigInt x = randomBigInt(rng, bits - 1);
+        BigInt d = randomBigInt(rng, bits);
+        CrtKey key;
+        key.p = p;
+        key.q = q;
+        key.dP = BigInt::modBig(d, p);
+        key.dQ = BigInt::modBig(d, q);
+        key.qInv = modInverse(q, p);
+        int reps = max(1, 4096 / bits);
+        double full = timeMs(reps, [&]()
+                             { modexp(N, d, x); });
+        double crt = timeMs(reps, [&]()
+                            { modexpCrt(x, key); });
+        cout << bits << "\t" << full << "\t\t" << crt << endl;
+    }
+
+    // Latency mode: một lũy thừa 8192 bit, số mũ đủ dài, tách theo số thread của máy
+    {
+        unsigned threads = max(1u, thread::hardware_concurrency());
+        BigInt N = randomBigInt(rng, 8192);
+        N.a[0] |= 1;
+        BigInt x = randomBigInt(rng, 8191);
+        BigInt k = randomBigInt(rng, 8192);
+        double serial = timeMs(1, [&]()
+                               { modexp(N, k, x); });
+        double split = timeMs(1, [&]()
+                              { modexpSplit(N, k, x, threads); });
+        cout << "\nthreads\tchunks\tserial(ms)\tsplit(ms)" << endl;
+        cout << threads << "\t" << latencySplit(k.bitLength(), threads) << "\t" << serial << "\t\t" << split << endl;
+    }
+
+    // Bình phương lặp: kernel bình phương Montgomery so với montMulRaw(a, a)
+    cout << "\nbits\trepeatedSquare(sq/s)\tmontMul(sq/s)" << endl;
+    for (int bits : {1024, 2048, 4096})
+    {
+        BigInt N = randomBigInt(rng, bits);
+        N.a[0] |= 1;
+        BigInt x = randomBigInt(rng, bits - 1);
+        const uint64_t t = 20000000 / bits;
+        RepeatedSquareStats stats;
+        repeatedSquare(x, t, N, 0, nullptr, &stats);
+        BigInt::MontgomeryCtx ctx = BigInt::montInit(N);
+        vector<uint32_t> cur = x.a;
+        cur.resize(N.a.size(), 0);
+        double viaMul = timeMs(1, [&]()
+                               { for (uint64_t i = 0; i < t; i++) BigInt::montMulRaw(cur.data(), cur.data(), cur.data(), ctx); });
+        cout << bits << "\t" << fixed << setprecision(0) << stats.perSecond() << "\t\t\t" << t * 1000 / viaMul
+             << defaultfloat << setprecision(6) << endl;
+    }
+
+    // Nhân số rất lớn: Comba bậc hai so với NTT ba số nguyên tố (mulInto tự chọn từ NTT_MIN_WORDS word)
+    cout << "\nwords\tcomba(ms)\tntt(ms)" << endl;
+    for (size_t words : {256, 512, 1024, 4096, 16384})
+    {
+        BigInt A = randomBigInt(rng, (int)words * 32), B = randomBigInt(rng, (int)words * 32);
+        vector<uint32_t> out(2 * words);
+        int reps = max(1, (int)(4096 / words));
+        double comba = timeMs(reps, [&]()
+                              { BigInt::mulComba(out.data(), A.a.data(), A.a.size(), B.a.data(), B.a.size()); });
+        double ntt = timeMs(reps, [&]()
+                            { nttMultiply(out, A.a.data(), A.a.size(), B.a.data(), B.a.size()); });
+        cout << words << "\t" << comba << "\t\t" << ntt << endl;
+    }
+
+    cout << "\n" << setw(20) << "engine" << "calls\tcycles/call" << endl;
+    for (int e = 0; e < ENGINE_COUNT; e++)
+    {
+        if (!g_engineCalls[e])
+            continue;
+        cout << setw(20) << engineName(e) << g_engineCalls[e] << "\t" << g_engineCycles[e] / g_engineCalls[e] << endl;
+    }
+}
+
+// ---- Batch mode ----
+struct BatchJob
+{
+    uint64_t seq;
+    string N, k, x;
+};
+
+// Hàng đợi riêng của mỗi worker, cả chủ lẫn worker lấy trộm đều lấy job cũ nhất ở đầu (FIFO):
+// kết quả ghi ra theo đúng thứ tự vào qua bộ đệm WINDOW job, lấy LIFO thì job cũ nằm chờ ở đầu hàng,
+// giữ bộ đệm không trôi được và làm độ trễ của nó tăng vọt. Hàng có khóa riêng nên không cần tách hai đầu.
+struct WorkQueue
+{
+    mutex lock;
+    deque<BatchJob> jobs;
+};
+
+struct LatencyBucket
+{
+    uint64_t count = 0;
+    double totalMs = 0, maxMs = 0;
+};
+
+// bai3 --batch <in|-> [out|-] [threads]: đọc các bộ ba N k x (hex đảo ngược như file test),
+// ghi y theo đúng thứ tự vào qua bộ đệm sắp xếp lại; tối đa WINDOW job đang xử lý cùng lúc.
+// Thống kê ops/sec và độ trễ theo cỡ N in ra cerr.
+int runBatch(const string &inPath, const string &outPath, unsigned threads)
+{
+    ifstream fileIn;
+    ofstream fileOut;
+    istream *in = &cin;
+    ostream *out = &cout;
+    if (inPath != "-")
+    {
+        fileIn.open(inPath);
+        if (!fileIn.is_open())
+        {
+            cerr << "Không mở được file " << inPath << endl;
+            return 1;
+        }
+        in = &fileIn;
+    }
+    if (outPath != "-")
+    {
+        fileOut.open(outPath);
+        if (!fileOut.is_open())
+        {
+            cerr << "Không mở được file " << outPath << endl;
+            return 1;
+        }
+        out = &fileOut;
+    }
+    if (threads == 0)
+        threads = max(1u, thread::hardware_concurrency());
+
+    const uint64_t WINDOW = 4096;
+    const int BUCKETS = 8; // <=64, <=128, ..., <=4096, >4096 bit
+    vector<WorkQueue> queues(threads);
+    atomic<uint64_t> queued(0);
+
+    // trạng thái chung: bộ đệm sắp xếp lại, tiến độ đọc/ghi, thống kê
+    mutex stateLock;
+    condition_variable workReady, slotFree;
+    vector<string> results(WINDOW);
+    vector<char> ready(WINDOW, 0);
+    uint64_t nextOut = 0, readCount = 0;
+    bool readDone = false;
+    LatencyBucket buckets[BUCKETS];
+
+    auto popJob = [&](unsigned self, BatchJob &job)
+    {
+        for (unsigned i = 0; i < threads; i++)
+        {
+            WorkQueue &q = queues[(self + i) % threads];
+            lock_guard<mutex> guard(q.lock);
+            if (q.jobs.empty())
+                continue;
+            job = move(q.jobs.front());
+            q.jobs.pop_front();
+            queued--;
+            return true;
+        }
+        return false;
+    };
+
+    auto worker = [&](unsigned self)
+    {
+        BatchJob job;
+        while (true)
+        {
+            if (!popJob(self, job))
+            {
+                unique_lock<mutex> l(stateLock);
+                workReady.wait(l, [&]()
+                               { return queued > 0 || readDone; });
+                if (queued == 0 && readDone)
+                    return;
+                continue;
+            }
+
+            auto start = chrono::steady_clock::now();
+            string y;
+            int bits = 0;
+            try
+            {
+                BigInt N = BigInt::fromHex(toBigEndianHex(job.N));
+                bits = N.bitLength();
+                y = toLittleEndianHex(modexp(N, BigInt::fromHex(toBigEndianHex(job.k)), BigInt::fromHex(toBigEndianHex(job.x))).toHex());
+            }
+            catch (const exception &e)
+            {
+                cerr << "Job " << job.seq << ": " << e.what() << endl;
+                y = "ERROR";
+            }
+            double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+            int b = 0;
+            while (b < BUCKETS - 1 && bits > (64 << b))
+                b++;
+
+            lock_guard<mutex> guard(stateLock);
+            buckets[b].count++;
+            buckets[b].totalMs += ms;
+            buckets[b].maxMs = max(buckets[b].maxMs, ms);
+            results[job.seq % WINDOW] = move(y);
+            ready[job.seq % WINDOW] = 1;
+            bool advanced = false;
+            while (ready[nextOut % WINDOW])
+            {
+                *out << results[nextOut % WINDOW] << "\n";
+                ready[nextOut % WINDOW] = 0;
+                results[nextOut % WINDOW].clear();
+                nextOut++;
+                advanced = true;
+            }
+            if (advanced)
+                slotFree.notify_one();
+        }
+    };
+
+    auto start = chrono::steady_clock::now();
+    vector<thread> pool;
+    for (unsigned t = 0; t < threads; t++)
+        pool.emplace_back(worker, t);
+
+    BatchJob job;
+    while (*in >> job.N >> job.k >> job.x)
+    {
+        {
+            unique_lock<mutex> l(stateLock);
+            slotFree.wait(l, [&]()
+                          { return readCount - nextOut < WINDOW; });
+            job.seq = readCount++;
+        }
+        // tăng queued trước khi đẩy job để bộ đếm không bao giờ âm
+        {
+            lock_guard<mutex> guard(stateLock);
+            queued++;
+        }
+        WorkQueue &q = queues[job.seq % threads];
+        {
+            lock_guard<mutex> guard(q.lock);
+            q.jobs.push_back(move(job));
+        }
+        workReady.notify_one();
+    }
+    {
+        lock_guard<mutex> guard(stateLock);
+        readDone = true;
+    }
+    workReady.notify_all();
+    for (auto &th : pool)
+        th.join();
+    out->flush();
+
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cerr << "Batch: " << readCount << " ops, " << threads << " threads, " << seconds << " s, "
+         << (seconds > 0 ? readCount / seconds : 0) << " ops/sec" << endl;
+    cerr << "N bits\tcount\tavg(ms)\tmax(ms)" << endl;
+    for (int b = 0; b < BUCKETS; b++)
+    {
+        if (!buckets[b].count)
+            continue;
+        cerr << (b == BUCKETS - 1 ? ">" + to_string(64 << (b - 1)) : "<=" + to_string(64 << b)) << "\t" << buckets[b].count
+             << "\t" << buckets[b].totalMs / buckets[b].count << "\t" << buckets[b].maxMs << endl;
+    }
+    return 0;
+}
+
+// bai3 --square <in|-> <t> [every] [file]: đọc N x (hex đảo ngược như file test), in y = x^(2^t) mod N.
+// Có every: checkpoint ghi vào file ánh xạ bộ nhớ, không có file thì in "i y_i" ra stdout.
+// Tốc độ (squarings/sec) in ra cerr.
+int runRepeatedSquare(const string &inPath, uint64_t t, uint64_t every, const string &checkpointPath)
+{
+    ifstream fileIn;
+    istream *in = &cin;
+    if (inPath != "-")
+    {
+        fileIn.open(inPath);
+        if (!fileIn.is_open())
+        {
+            cerr << "Không mở được file " << inPath << endl;
+            return 1;
+        }
+        in = &fileIn;
+    }
+    string nHex, xHex;
+    if (!(*in >> nHex >> xHex))
+    {
+        cerr << "Thiếu N hoặc x" << endl;
+        return 1;
+    }
+
+    BigInt N = BigInt::fromHex(toBigEndianHex(nHex)), x = BigInt::fromHex(toBigEndianHex(xHex));
+    RepeatedSquareStats stats;
+    BigInt y;
+    if (!checkpointPath.empty())
+        y = repeatedSquareToFile(x, t, N, every, checkpointPath, &stats);
+    else
+        y = repeatedSquare(x, t, N, every, [](uint64_t i, const BigInt &v)
+                           { cout << i << " " << toLittleEndianHex(v.toHex()) << "\n"; },
+                           &stats);
+    cout << toLittleEndianHex(y.toHex()) << endl;
+    cerr << stats.squarings << " squarings, " << stats.seconds << " s, " << fixed << setprecision(0)
+         << stats.perSecond() << " squarings/sec" << endl;
+    return 0;
+}
+
+int main(int argc, char *argv[])
 {
+    if (argc >= 2 && string(argv[1]) == "bench")
+    {
+        runBenchmark();
+        return 0;
+    }
+
+    if (argc >= 4 && string(argv[1]) == "--square")
+    {
+        uint64_t every = argc >= 5 ? stoull(argv[4]) : 0;
+        return runRepeatedSquare(argv[2], stoull(argv[3]), every, argc >= 6 ? argv[5] : "");
+    }
+
+    if (argc >= 3 && string(argv[1]) == "--batch")
+    {
+        unsigned threads = argc >= 5 ? (unsigned)stoul(argv[4]) : 0;
+        return runBatch(argv[2], argc >= 4 ? argv[3] : "-", threads);
+    }
+
+    // --stats: in bộ đếm của từng test và tổng cộng dưới dạng JSON
+    // --latency [threads]: lũy thừa qua modexpSplit (tách số mũ cho nhiều thread)
+    bool dumpStats = false, latency = false;
+    unsigned latencyThreads = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        if (string(argv[i]) == "--stats")
+            dumpStats = true;
+        if (string(argv[i]) == "--latency")
+        {
+            latency = true;
+            if (i + 1 < argc && isdigit((unsigned char)argv[i + 1][0]))
+                latencyThreads = (unsigned)stoul(argv[++i]);
+        }
+    }
+
     string folder = "project_01_03";
-    int total = 9;
+    int total = 20;
     int passCount = 0;
+    int checked = 0;
 
     for (int i = 0; i < total; i++)
     {
@@ -368,9 +2887,13 @@ int main()
             continue;
         }
 
-        // Đọc dữ liệu
+        // Đọc dữ liệu; dạng mở rộng có thêm p, q và tùy chọn dP, dQ, qInv (cùng kiểu hex đảo ngược)
         string A_hex, B_hex, C_hex;
         fin >> A_hex >> B_hex >> C_hex;
+        vector<string> extra;
+        string token;
+        while (fin >> token)
+            extra.push_back(token);
         fin.close();
 
         cout << A_hex << endl;
@@ -381,25 +2904,64 @@ int main()
         BigInt A, B, C;
         try
         {
-            cerr << "DBG: before fromHex A\n";
             A = BigInt::fromHex(toBigEndianHex(A_hex));
-            cerr << "DBG: after fromHex A\n";
-            cerr << "DBG: before fromHex B\n";
             B = BigInt::fromHex(toBigEndianHex(B_hex));
-            cerr << "DBG: after fromHex B\n";
-            cerr << "DBG: before fromHex C\n";
             C = BigInt::fromHex(toBigEndianHex(C_hex));
-            cerr << "DBG: after fromHex C\n";
         }
         catch (const exception &e)
         {
             cerr << "Exception during fromHex(): " << e.what() << "\n";
             return 1;
         }
-        // Tính kết quả
-        cerr << "DBG A(HEX)=" << A.toHex() << " B(HEX)=" << B.toHex() << " C(HEX)=" << C.toHex() << "\n";
-        BigInt result = BigInt::power(A, B, C);
+        // Tính kết quả: file test theo thứ tự N, k, x -> y = x^k mod N
+        BAI3_TRACE(1, "A(HEX)=" << A.toHex() << " B(HEX)=" << B.toHex() << " C(HEX)=" << C.toHex());
+        BigInt result;
+        if ((extra.size() == 2 || extra.size() == 5) && !B.isZero())
+        {
+            BigInt p = BigInt::fromHex(toBigEndianHex(extra[0]));
+            BigInt q = BigInt::fromHex(toBigEndianHex(extra[1]));
+            if (BigInt::compare(BigInt::multiply(p, q), A) != 0)
+            {
+                cerr << "Test " << i << ": p*q != N, bỏ qua CRT\n";
+                result = modexp(A, B, C);
+            }
+            else if (BigInt::compare(p, q) == 0)
+            {
+                cerr << "Test " << i << ": p == q, bỏ qua CRT\n";
+                result = modexp(A, B, C);
+            }
+            else
+            {
+                // gcd(p, q) != 1 (modInverse ném lỗi), p hoặc q <= 1...: cũng quay về modexp thay vì dừng chương trình
+                try
+                {
+                    CrtKey key;
+                    if (extra.size() == 5)
+                    {
+                        key.p = p;
+                        key.q = q;
+                        key.dP = BigInt::fromHex(toBigEndianHex(extra[2]));
+                        key.dQ = BigInt::fromHex(toBigEndianHex(extra[3]));
+                        key.qInv = BigInt::fromHex(toBigEndianHex(extra[4]));
+                    }
+                    else
+                        key = CrtKey::fromFactors(p, q, B);
+                    result = modexpCrt(C, key);
+                }
+                catch (const exception &e)
+                {
+                    cerr << "Test " << i << ": CRT lỗi (" << e.what() << "), bỏ qua CRT\n";
+                    result = modexp(A, B, C);
+                }
+            }
+        }
+        else if (latency)
+            result = modexpSplit(A, B, C, latencyThreads);
+        else
+            result = modexp(A, B, C);
         string resultHex = toLittleEndianHex(result.toHex());
+        if (dumpStats)
+            cout << "Stats: " << lastCallCounters().toJson() << endl;
 
         // Ghi ra file kết quả
         ofstream fout(myOutFile.c_str());
@@ -408,9 +2970,15 @@ int main()
 
         // So sánh với file output chuẩn
         ifstream refFile(outFile.c_str());
+        if (!refFile.is_open())
+        {
+            cout << "Test " << i << ": " << resultHex << " (không có file .out)" << endl;
+            continue;
+        }
         string expected;
         refFile >> expected;
         refFile.close();
+        checked++;
 
         if (resultHex == expected)
         {
@@ -425,6 +2993,8 @@ int main()
         }
     }
 
-    cout << "\nTổng kết: " << passCount << "/" << total << " test case pass." << endl;
+    cout << "\nTổng kết: " << passCount << "/" << checked << " test case pass." << endl;
+    if (dumpStats)
+        cout << "Total stats: " << totalCounters().toJson() << endl;
     return 0;
 }
@@ -1,5 +1,10 @@
 #include <bits/stdc++.h>
+#include "mont_cache.h"
 #include <fstream>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define HAVE_IFMA_KERNEL 1
+#endif
 using namespace std;
 
 const int LIMBS = 32; // 1024-bit = 32 * 32
@@ -8,12 +13,36 @@ struct BigInt
     uint32_t v[LIMBS] = {0};
 };
 
+// ---- AVX-512 IFMA (radix 2^52) ----
+// Số được lưu thành digit 52 bit trong uint64, số digit làm tròn lên bội của 8 (một thanh ghi zmm).
+// Tối đa theo LIMBS (1024 bit = 20 digit -> 24).
+const int IFMA_MAX_DIGITS = ((LIMBS * 32 + 51) / 52 + 7) / 8 * 8;
+const int IFMA_MIN_LIMBS = 24; // dưới ~768 bit phần chuyển radix và R^2 riêng không bù được, giữ kernel 32 bit
+const uint64_t MASK52 = (1ULL << 52) - 1;
+
+struct IfmaCtx
+{
+    int digits = 0; // 0: không dùng IFMA cho N này
+    uint64_t k0;    // -N^{-1} mod 2^52
+    alignas(64) uint64_t N[IFMA_MAX_DIGITS];
+    alignas(64) uint64_t R2[IFMA_MAX_DIGITS]; // R^2 mod N với R = 2^(52 * digits)
+};
+
+// chọn lúc khởi động theo CPUID, tắt được để so với kernel 32 bit
+#ifdef HAVE_IFMA_KERNEL
+bool g_use_ifma = __builtin_cpu_supports("avx512ifma");
+#else
+bool g_use_ifma = false;
+#endif
+
 // ---- Montgomery Core ----
 struct MontgomeryCtx
 {
     BigInt N;       // modulus
     uint32_t n_inv; // -N^{-1} mod 2^32
-    BigInt R2;      // R^2 mod N
+    BigInt R2;      // R^2 mod N (R = 2^(32n))
+    int n;          // số word thực của N, mọi phép toán chỉ chạy trên n word
+    IfmaCtx ifma;   // dạng radix 2^52 của cùng N (nếu CPU hỗ trợ)
 };
 
 // tính n_inv = -N^{-1} mod 2^32
@@ -25,10 +54,10 @@ uint32_t montgomery_inv32(uint32_t n)
     return ~x + 1;
 }
 
-// so sánh >=
-bool geq(const BigInt &a, const BigInt &b)
+// so sánh >= trên n word thấp
+bool geq(const BigInt &a, const BigInt &b, int n = LIMBS)
 {
-    for (int i = LIMBS - 1; i >= 0; --i)
+    for (int i = n - 1; i >= 0; --i)
     {
         if (a.v[i] > b.v[i])
             return true;
@@ -38,11 +67,11 @@ bool geq(const BigInt &a, const BigInt &b)
     return true;
 }
 
-// trừ mod
-void sub_mod(BigInt &a, const BigInt &b)
+// trừ mod 2^(32n) trên n word thấp
+void sub_mod(BigInt &a, const BigInt &b, int n = LIMBS)
 {
     uint64_t borrow = 0;
-    for (int i = 0; i < LIMBS; ++i)
+    for (int i = 0; i < n; ++i)
     {
         uint64_t diff = (uint64_t)a.v[i] - b.v[i] - borrow;
         a.v[i] = (uint32_t)diff;
@@ -50,47 +79,60 @@ void sub_mod(BigInt &a, const BigInt &b)
     }
 }
 
-// MontMul (a * b * R^-1 mod N)
+// rút gọn lười trong mont_mul (mặc định bật), tắt để mọi kết quả trung gian luôn < N
+bool g_lazy_mont = true;
+
+// MontMul (a * b * R^-1 mod N), chỉ chạy trên ctx.n word của N
 void mont_mul(BigInt &res, const BigInt &a, const BigInt &b, const MontgomeryCtx &ctx)
 {
-    uint64_t T[LIMBS * 2] = {0};
+    const int n = ctx.n;
+    uint64_t T[LIMBS * 2 + 1];
+    fill(T, T + 2 * n + 1, 0);
 
     // t = a * b
-    for (int i = 0; i < LIMBS; ++i)
+    for (int i = 0; i < n; ++i)
     {
         uint64_t carry = 0;
-        for (int j = 0; j < LIMBS; ++j)
+        for (int j = 0; j < n; ++j)
         {
             uint64_t prod = (uint64_t)a.v[i] * b.v[j] + T[i + j] + carry;
             T[i + j] = (uint32_t)prod;
             carry = prod >> 32;
         }
-        T[i + LIMBS] += carry;
+        T[i + n] = carry;
     }
 
     // Montgomery reduction
-    for (int i = 0; i < LIMBS; ++i)
+    for (int i = 0; i < n; ++i)
     {
         uint32_t m = (uint32_t)(T[i] * ctx.n_inv);
         uint64_t carry = 0;
-        for (int j = 0; j < LIMBS; ++j)
+        for (int j = 0; j < n; ++j)
         {
             uint64_t prod = (uint64_t)m * ctx.N.v[j] + T[i + j] + carry;
             T[i + j] = (uint32_t)prod;
             carry = prod >> 32;
         }
-        uint64_t sum = T[i + LIMBS] + carry;
-        T[i + LIMBS] = (uint32_t)sum;
-        // phần cao hơn LIMBS+1 bỏ vì /R
+        // lan truyền nhớ lên các word cao (tối đa tới T[2n])
+        for (int k = i + n; carry; ++k)
+        {
+            uint64_t sum = T[k] + carry;
+            T[k] = (uint32_t)sum;
+            carry = sum >> 32;
+        }
     }
 
-    // copy phần cao (T >> 32*LIMBS)
-    for (int i = 0; i < LIMBS; ++i)
-        res.v[i] = (uint32_t)T[i + LIMBS];
+    // copy phần cao (T >> 32*n), word trên n luôn bằng 0
+    for (int i = 0; i < n; ++i)
+        res.v[i] = (uint32_t)T[i + n];
+    for (int i = n; i < LIMBS; ++i)
+        res.v[i] = 0;
 
-    // nếu >= N thì trừ N
-    if (geq(res, ctx.N))
-        sub_mod(res, ctx.N);
+    // Lazy (almost Montgomery): a, b < R cho T < R + N, chỉ trừ N khi tràn sang T[2n] nên kết quả < R,
+    // không cần so sánh đủ n word; from_mont đưa về [0, N) một lần khi ra khỏi miền Montgomery.
+    // Chế độ thường: a, b < N, trừ để kết quả < N.
+    if (T[2 * n] || (!g_lazy_mont && geq(res, ctx.N, n)))
+        sub_mod(res, ctx.N, n);
 }
 
 // chuyển vào dạng Montgomery: a * R mod N
@@ -105,30 +147,697 @@ void from_mont(BigInt &r, const BigInt &a, const MontgomeryCtx &ctx)
     BigInt one = {};
     one.v[0] = 1;
     mont_mul(r, a, one, ctx);
+    // a < R nên r <= N: một lần trừ cuối cho dạng chuẩn
+    if (geq(r, ctx.N, ctx.n))
+        sub_mod(r, ctx.N, ctx.n);
 }
 
-// Simple binary exponentiation using Montgomery multiplication
-void mont_pow_simple(BigInt &res, const BigInt &x, const BigInt &k, const MontgomeryCtx &ctx)
+// số bit thực của k (vị trí bit 1 cao nhất + 1)
+int bit_length(const BigInt &k)
 {
-    BigInt x1;
-    to_mont(x1, x, ctx);
+    for (int i = LIMBS - 1; i >= 0; --i)
+        if (k.v[i])
+            return i * 32 + (32 - __builtin_clz(k.v[i]));
+    return 0;
+}
 
-    BigInt result;
-    BigInt one = {};
-    one.v[0] = 1;
-    to_mont(result, one, ctx);
+// độ rộng cửa sổ theo số bit của số mũ
+int window_bits(int exp_bits)
+{
+    if (exp_bits > 671)
+        return 6;
+    if (exp_bits > 239)
+        return 5;
+    if (exp_bits > 79)
+        return 4;
+    if (exp_bits > 23)
+        return 3;
+    return 1;
+}
+
+// x mod N khi x rộng hơn n word (mont_mul chỉ đọc n word thấp): dịch từng bit như mont_init
+void reduce_wide(BigInt &r, const BigInt &x, const MontgomeryCtx &ctx)
+{
+    BigInt acc = {};
+    for (int i = bit_length(x) - 1; i >= 0; --i)
+    {
+        uint64_t carry = (x.v[i / 32] >> (i % 32)) & 1;
+        for (int j = 0; j < ctx.n; ++j)
+        {
+            uint64_t v = ((uint64_t)acc.v[j] << 1) | carry;
+            acc.v[j] = (uint32_t)v;
+            carry = v >> 32;
+        }
+        if (carry || geq(acc, ctx.N, ctx.n))
+            sub_mod(acc, ctx.N, ctx.n);
+    }
+    r = acc;
+}
+
+// x -> dạng Montgomery, rút gọn trước nếu x rộng hơn N
+void load_base(BigInt &x1, const BigInt &x, const MontgomeryCtx &ctx)
+{
+    if (bit_length(x) > ctx.n * 32)
+    {
+        BigInt xr;
+        reduce_wide(xr, x, ctx);
+        to_mont(x1, xr, ctx);
+    }
+    else
+        to_mont(x1, x, ctx);
+}
+
+// word 32 bit <-> digit 52 bit
+void to_radix52(uint64_t *out, const BigInt &a, int digits)
+{
+    for (int d = 0; d < digits; ++d)
+    {
+        uint64_t r = 0;
+        for (int b = 0; b < 52; b += 4)
+        {
+            int pos = d * 52 + b;
+            uint64_t nib = pos < LIMBS * 32 ? (a.v[pos / 32] >> (pos % 32)) & 0xF : 0;
+            r |= nib << b;
+        }
+        out[d] = r;
+    }
+}
+
+void from_radix52(BigInt &r, const uint64_t *in, int digits)
+{
+    r = BigInt();
+    for (int d = 0; d < digits; ++d)
+        for (int b = 0; b < 52; b += 4)
+        {
+            int pos = d * 52 + b;
+            if (pos < LIMBS * 32)
+                r.v[pos / 32] |= (uint32_t)((in[d] >> b) & 0xF) << (pos % 32);
+        }
+}
+
+#ifdef HAVE_IFMA_KERNEL
+// digit thấp nhất của thanh ghi (maskz: cast không mask cũng đọc _mm_undefined như alignr)
+__attribute__((target("avx512f"))) inline uint64_t lane0(__m512i x)
+{
+    return _mm_cvtsi128_si64(_mm512_maskz_extracti32x4_epi32(0xF, x, 0));
+}
+
+// res = a * b * 2^(-52*digits) mod N, a < 2^(52*digits), b < N.
+// Mỗi vòng: cộng phần thấp a*b_i và y*N, dịch phải một digit (valignq), rồi cộng phần cao;
+// các lane tích lũy chưa chuẩn hóa (mỗi vòng cộng < 2^54 nên 80 digit vẫn vừa 64 bit),
+// chỉ chuẩn hóa nhớ và trừ N một lần ở cuối.
+__attribute__((target("avx512f,avx512ifma"))) void ifma_mul(uint64_t *res, const uint64_t *a, const uint64_t *b, const IfmaCtx &c)
+{
+    const int V = c.digits / 8;
+    const __m512i zero = _mm512_setzero_si512();
+    // khởi tạo cả mảng: phần sau V không dùng nhưng compiler không chứng minh được
+    __m512i X[IFMA_MAX_DIGITS / 8], A[IFMA_MAX_DIGITS / 8], M[IFMA_MAX_DIGITS / 8];
+    for (int v = 0; v < IFMA_MAX_DIGITS / 8; ++v)
+        X[v] = A[v] = M[v] = zero;
+    for (int v = 0; v < V; ++v)
+    {
+        A[v] = _mm512_loadu_si512(a + 8 * v);
+        M[v] = _mm512_load_si512(c.N + 8 * v);
+    }
+
+    for (int i = 0; i < c.digits; ++i)
+    {
+        __m512i bi = _mm512_set1_epi64(b[i]);
+        for (int v = 0; v < V; ++v)
+            X[v] = _mm512_madd52lo_epu64(X[v], A[v], bi);
+        uint64_t x0 = lane0(X[0]);
+        __m512i y = _mm512_set1_epi64((x0 * c.k0) & MASK52);
+        for (int v = 0; v < V; ++v)
+            X[v] = _mm512_madd52lo_epu64(X[v], M[v], y);
+
+        // digit 0 giờ chia hết cho 2^52: bỏ đi, nhớ của nó cộng vào digit mới
+        uint64_t carry = (uint64_t)lane0(X[0]) >> 52;
+        // bản maskz: bản không mask lấy _mm512_undefined làm nguồn (-Wmaybe-uninitialized)
+        for (int v = 0; v < V - 1; ++v)
+            X[v] = _mm512_maskz_alignr_epi64(0xFF, X[v + 1], X[v], 1);
+        X[V - 1] = _mm512_maskz_alignr_epi64(0xFF, zero, X[V - 1], 1);
+        X[0] = _mm512_add_epi64(X[0], _mm512_zextsi128_si512(_mm_cvtsi64_si128(carry)));
+
+        for (int v = 0; v < V; ++v)
+        {
+            X[v] = _mm512_madd52hi_epu64(X[v], A[v], bi);
+            X[v] = _mm512_madd52hi_epu64(X[v], M[v], y);
+        }
+    }
+
+    alignas(64) uint64_t T[IFMA_MAX_DIGITS];
+    for (int v = 0; v < V; ++v)
+        _mm512_store_si512(T + 8 * v, X[v]);
+    uint64_t carry = 0;
+    for (int d = 0; d < c.digits; ++d)
+    {
+        uint64_t t = T[d] + carry;
+        T[d] = t & MASK52;
+        carry = t >> 52;
+    }
+
+    // kết quả < 2N: trừ N nếu tràn hoặc >= N
+    bool ge = carry != 0;
+    if (!ge)
+    {
+        ge = true;
+        for (int d = c.digits - 1; d >= 0; --d)
+            if (T[d] != c.N[d])
+            {
+                ge = T[d] > c.N[d];
+                break;
+            }
+    }
+    if (ge)
+    {
+        uint64_t borrow = 0;
+        for (int d = 0; d < c.digits; ++d)
+        {
+            uint64_t t = T[d] - c.N[d] - borrow;
+            T[d] = t & MASK52;
+            borrow = t >> 63;
+        }
+    }
+    memcpy(res, T, c.digits * sizeof(uint64_t));
+}
+#else
+void ifma_mul(uint64_t *, const uint64_t *, const uint64_t *, const IfmaCtx &) {}
+#endif
+
+// ---- Kernel nhân Montgomery ----
+// mont_pow, multi_modexp và comb viết một lần theo Arith: Elem là một phần tử ở dạng Montgomery của kernel,
+// enter/leave đưa vào/ra dạng Montgomery, mul là phép nhân Montgomery (r được trùng a hoặc b).
+// ScalarArith: mont_mul 32 bit, R = 2^(32n). IfmaArith: ifma_mul radix 2^52, R = 2^(52 * digits).
+struct ScalarArith
+{
+    typedef BigInt Elem;
+    const MontgomeryCtx &ctx;
+
+    void mul(Elem &r, const Elem &a, const Elem &b) const { mont_mul(r, a, b, ctx); }
+    void enter(Elem &r, const BigInt &x) const { load_base(r, x, ctx); }
+    void leave(BigInt &r, const Elem &a) const { from_mont(r, a, ctx); }
+    void one(Elem &r) const
+    {
+        BigInt o = {};
+        o.v[0] = 1;
+        to_mont(r, o, ctx);
+    }
+};
+
+struct alignas(64) Ifma52
+{
+    uint64_t d[IFMA_MAX_DIGITS];
+};
+
+struct IfmaArith
+{
+    typedef Ifma52 Elem;
+    const MontgomeryCtx &ctx;
+
+    void mul(Elem &r, const Elem &a, const Elem &b) const { ifma_mul(r.d, a.d, b.d, ctx.ifma); }
+    void enter(Elem &r, const BigInt &x) const
+    {
+        BigInt xr = x;
+        if (bit_length(x) > ctx.n * 32)
+            reduce_wide(xr, x, ctx);
+        Elem t;
+        to_radix52(t.d, xr, ctx.ifma.digits);
+        ifma_mul(r.d, t.d, ctx.ifma.R2, ctx.ifma);
+    }
+    // ifma_mul đã rút gọn hẳn (< N), nhân với 1 là ra kết quả
+    void leave(BigInt &r, const Elem &a) const
+    {
+        Elem o = {}, t;
+        o.d[0] = 1;
+        ifma_mul(t.d, a.d, o.d, ctx.ifma);
+        from_radix52(r, t.d, ctx.ifma.digits);
+    }
+    // 1 ở dạng Montgomery = R mod N = R^2 * R^-1
+    void one(Elem &r) const
+    {
+        Elem o = {};
+        o.d[0] = 1;
+        ifma_mul(r.d, o.d, ctx.ifma.R2, ctx.ifma);
+    }
+};
+
+// kernel IFMA khi CPU hỗ trợ và N đủ lớn để mont_init dựng ctx.ifma
+bool use_ifma(const MontgomeryCtx &ctx)
+{
+    return g_use_ifma && ctx.ifma.digits;
+}
+
+// tb[i] = x^(2i+1), i < 2^(w-1); tb[0] = x đã ở dạng Montgomery
+template <class Arith>
+void odd_powers(typename Arith::Elem *tb, int w, const Arith &ar)
+{
+    if (w == 1)
+        return;
+    typename Arith::Elem x2;
+    ar.mul(x2, tb[0], tb[0]);
+    for (int i = 1; i < (1 << (w - 1)); ++i)
+        ar.mul(tb[i], tb[i - 1], x2);
+}
+
+// Sliding-window exponentiation using Montgomery multiplication
+template <class Arith>
+void pow_window(BigInt &res, const BigInt &x, const BigInt &k, const Arith &ar)
+{
+    // Bảng lũy thừa lẻ x^1, x^3, ..., x^63 (w tối đa 6): liền nhau, căn lề 64 byte, dùng lại giữa các lần gọi.
+    // Mỗi thread (và mỗi kernel) một bảng, như g_windowTable của bai3.cpp, để mont_pow gọi song song được.
+    alignas(64) thread_local typename Arith::Elem window_table[1 << 5];
+
+    int w = window_bits(bit_length(k));
+    ar.enter(window_table[0], x);
+    odd_powers(window_table, w, ar);
+
+    typename Arith::Elem result;
+    ar.one(result);
+
+    // Quét từ bit 1 cao nhất của k xuống LSB, mỗi cửa sổ kết thúc bằng bit 1;
+    // cửa sổ đầu tiên gán thẳng từ bảng, không bình phương 1
+    bool started = false;
+    for (int i = bit_length(k) - 1; i >= 0;)
+    {
+        if (((k.v[i / 32] >> (i % 32)) & 1) == 0)
+        {
+            ar.mul(result, result, result);
+            --i;
+            continue;
+        }
+
+        int l = max(0, i - w + 1);
+        while (((k.v[l / 32] >> (l % 32)) & 1) == 0)
+            ++l;
+        int win = 0;
+        for (int j = i; j >= l; --j)
+            win = (win << 1) | ((k.v[j / 32] >> (j % 32)) & 1);
+
+        if (started)
+        {
+            for (int j = l; j <= i; ++j)
+                ar.mul(result, result, result);
+            ar.mul(result, result, window_table[win >> 1]);
+        }
+        else
+        {
+            result = window_table[win >> 1];
+            started = true;
+        }
+        i = l - 1;
+    }
+
+    ar.leave(res, result);
+}
+
+void mont_pow(BigInt &res, const BigInt &x, const BigInt &k, const MontgomeryCtx &ctx)
+{
+    if (use_ifma(ctx))
+        pow_window(res, x, k, IfmaArith{ctx});
+    else
+        pow_window(res, x, k, ScalarArith{ctx});
+}
+
+// res = x[0]^k[0] * x[1]^k[1] * ... mod N (Straus, cửa sổ xen kẽ):
+// một chuỗi bình phương chung cho mọi số hạng, mỗi số hạng có bảng lũy thừa lẻ riêng
+// và được nhân vào đúng vị trí cửa sổ của nó kết thúc. Hai, ba số hạng tốn gần bằng một lần mont_pow.
+template <class Arith>
+void multi_window(BigInt &res, const vector<BigInt> &x, const vector<BigInt> &k, const Arith &ar)
+{
+    int m = (int)x.size();
+    int top = 0;
+    for (int t = 0; t < m; ++t)
+        top = max(top, bit_length(k[t]));
+
+    // tables[t][i] = x_t^(2i+1); at[t][bit] = chỉ số bảng + 1 nếu cửa sổ của số hạng t kết thúc ở bit
+    vector<vector<typename Arith::Elem>> tables(m);
+    vector<vector<uint8_t>> at(m, vector<uint8_t>(top, 0));
+    for (int t = 0; t < m; ++t)
+    {
+        int bits = bit_length(k[t]);
+        if (bits == 0)
+            continue;
+        int w = window_bits(bits);
+        tables[t].resize(1 << (w - 1));
+        ar.enter(tables[t][0], x[t]);
+        odd_powers(tables[t].data(), w, ar);
+
+        for (int i = bits - 1; i >= 0;)
+        {
+            if (((k[t].v[i / 32] >> (i % 32)) & 1) == 0)
+            {
+                --i;
+                continue;
+            }
+            int l = max(0, i - w + 1);
+            while (((k[t].v[l / 32] >> (l % 32)) & 1) == 0)
+                ++l;
+            int win = 0;
+            for (int j = i; j >= l; --j)
+                win = (win << 1) | ((k[t].v[j / 32] >> (j % 32)) & 1);
+            at[t][l] = (uint8_t)((win >> 1) + 1);
+            i = l - 1;
+        }
+    }
+
+    typename Arith::Elem result;
+    ar.one(result);
+
+    bool started = false;
+    for (int i = top - 1; i >= 0; --i)
+    {
+        if (started)
+            ar.mul(result, result, result);
+        for (int t = 0; t < m; ++t)
+        {
+            if (!at[t][i])
+                continue;
+            if (started)
+                ar.mul(result, result, tables[t][at[t][i] - 1]);
+            else
+            {
+                result = tables[t][at[t][i] - 1];
+                started = true;
+            }
+        }
+    }
+
+    ar.leave(res, result);
+}
+
+// cùng cách chọn kernel với mont_pow, nên không bao giờ chậm hơn gọi mont_pow cho từng số hạng:
+// bảng của mỗi số hạng giống hệt bảng của mont_pow, chỉ chuỗi bình phương được dùng chung
+void multi_modexp(BigInt &res, const vector<BigInt> &x, const vector<BigInt> &k, const MontgomeryCtx &ctx)
+{
+    if (x.size() == 1)
+        mont_pow(res, x[0], k[0], ctx);
+    else if (use_ifma(ctx))
+        multi_window(res, x, k, IfmaArith{ctx});
+    else
+        multi_window(res, x, k, ScalarArith{ctx});
+}
+
+// ---- N chẵn: N = 2^s * m ----
+// Montgomery chỉ chạy với m lẻ; mod 2^s chỉ cần nhân cắt cụt (giữ s bit thấp), m^-1 mod 2^s bằng Hensel,
+// ghép bằng CRT: y = y1 + m * ((y2 - y1) * m^-1 mod 2^s). Không cần phép chia nào.
+
+// r = a * b mod 2^(32 * words): chỉ tính các tích i + j < words
+void mul_low(BigInt &r, const BigInt &a, const BigInt &b, int words)
+{
+    uint32_t t[LIMBS] = {0};
+    for (int i = 0; i < words; ++i)
+    {
+        uint64_t carry = 0;
+        for (int j = 0; i + j < words; ++j)
+        {
+            uint64_t cur = (uint64_t)t[i + j] + (uint64_t)a.v[i] * b.v[j] + carry;
+            t[i + j] = (uint32_t)cur;
+            carry = cur >> 32;
+        }
+    }
+    memcpy(r.v, t, sizeof(t));
+}
+
+// xóa mọi bit từ vị trí s trở lên
+void mask_bits(BigInt &v, int s)
+{
+    for (int i = 0; i < LIMBS; ++i)
+    {
+        if (i * 32 >= s)
+            v.v[i] = 0;
+        else if (i * 32 + 32 > s)
+            v.v[i] &= (1u << (s % 32)) - 1;
+    }
+}
+
+void shift_right(BigInt &r, const BigInt &a, int s)
+{
+    BigInt t = {};
+    int q = s / 32, b = s % 32;
+    for (int i = 0; i + q < LIMBS; ++i)
+    {
+        uint64_t w = a.v[i + q];
+        if (i + q + 1 < LIMBS)
+            w |= (uint64_t)a.v[i + q + 1] << 32;
+        t.v[i] = (uint32_t)(w >> b);
+    }
+    r = t;
+}
+
+// res = x^k mod 2^s, cửa sổ trượt như mont_pow trên phép nhân cắt cụt (bảng trên stack của thread gọi)
+void pow_mod2k(BigInt &res, const BigInt &x, const BigInt &k, int s)
+{
+    int words = (s + 31) / 32;
+    BigInt xs = x;
+    mask_bits(xs, s);
+    res = BigInt();
+    // x chẵn: x^k chia hết cho 2^k, đủ để bằng 0 khi k >= s
+    if (!(xs.v[0] & 1) && bit_length(k) > 0 && (bit_length(k) > 31 || (int)k.v[0] >= s))
+        return;
+
+    int w = window_bits(bit_length(k));
+    BigInt table[1 << 5];
+    table[0] = xs;
+    if (w > 1)
+    {
+        BigInt x2;
+        mul_low(x2, xs, xs, words);
+        for (int i = 1; i < (1 << (w - 1)); ++i)
+            mul_low(table[i], table[i - 1], x2, words);
+    }
+
+    BigInt result = {};
+    result.v[0] = 1;
+    bool started = false;
+    for (int i = bit_length(k) - 1; i >= 0;)
+    {
+        if (((k.v[i / 32] >> (i % 32)) & 1) == 0)
+        {
+            mul_low(result, result, result, words);
+            --i;
+            continue;
+        }
+
+        int l = max(0, i - w + 1);
+        while (((k.v[l / 32] >> (l % 32)) & 1) == 0)
+            ++l;
+        int win = 0;
+        for (int j = i; j >= l; --j)
+            win = (win << 1) | ((k.v[j / 32] >> (j % 32)) & 1);
+
+        if (started)
+        {
+            for (int j = l; j <= i; ++j)
+                mul_low(result, result, result, words);
+            mul_low(result, result, table[win >> 1], words);
+        }
+        else
+        {
+            result = table[win >> 1];
+            started = true;
+        }
+        i = l - 1;
+    }
+    mask_bits(result, s);
+    res = result;
+}
+
+// inv = m^-1 mod 2^(32 * words) với m lẻ: Newton/Hensel, mỗi vòng gấp đôi số bit đúng bắt đầu từ 32
+void inverse_mod2k(BigInt &inv, const BigInt &m, int words)
+{
+    inv = BigInt();
+    inv.v[0] = 0u - montgomery_inv32(m.v[0]);
+    for (int bits = 32; bits < 32 * words; bits *= 2)
+    {
+        // inv = inv * (2 - m * inv)
+        BigInt t;
+        mul_low(t, m, inv, words);
+        uint64_t borrow = 0;
+        for (int i = 0; i < words; ++i)
+        {
+            uint64_t diff = (uint64_t)(i == 0 ? 2 : 0) - t.v[i] - borrow;
+            t.v[i] = (uint32_t)diff;
+            borrow = diff >> 63;
+        }
+        mul_low(inv, inv, t, words);
+    }
+}
+
+// y = y1 + m * ((y2 - y1) * m^-1 mod 2^s) với y1 = y mod m, y2 = y mod 2^s
+void crt_even(BigInt &y, const BigInt &y1, const BigInt &y2, const BigInt &m, int s)
+{
+    int words = (s + 31) / 32;
+    BigInt diff = y2, inv, h;
+    sub_mod(diff, y1, words);
+    inverse_mod2k(inv, m, words);
+    mul_low(h, diff, inv, words);
+    mask_bits(h, s);
+
+    // m * h < N nên vừa LIMBS word
+    BigInt mh;
+    mul_low(mh, m, h, LIMBS);
+    uint64_t carry = 0;
+    for (int i = 0; i < LIMBS; ++i)
+    {
+        uint64_t sum = (uint64_t)mh.v[i] + y1.v[i] + carry;
+        y.v[i] = (uint32_t)sum;
+        carry = sum >> 32;
+    }
+}
+
+// ---- Fixed-base (Lim-Lee comb) ----
+// Cùng (x, N) với rất nhiều k: dựng bảng một lần, mỗi lần lũy thừa chỉ còn ~a/v bình phương.
+// Số mũ tối đa max_bits chia thành h hàng a = ceil(max_bits/h) bit; mỗi hàng cắt thành v khối b = ceil(a/v) cột.
+// G[s][j] = prod_{i: bit i của j} x^(2^(i*a + s*b)), bộ nhớ v * 2^h phần tử, đánh đổi: h, v lớn -> ít phép nhân hơn.
+// Sau comb_init bảng chỉ đọc: comb_pow nhận const&, không ghi gì vào tb, nên nhiều thread gọi comb_pow
+// trên cùng một bảng được. comb_init thì không được chạy song song với comb_pow trên cùng bảng.
+struct FixedBaseTable
+{
+    MontgomeryCtx ctx;
+    BigInt x;
+    int max_bits, h, v, a, b;
+    bool ifma;          // kernel chọn lúc comb_init, bảng nằm ở G52 thay vì G
+    vector<BigInt> G;   // G[s * 2^h + j], dạng Montgomery
+    vector<Ifma52> G52; // như G nhưng radix 2^52
+};
+
+template <class Arith>
+void comb_build(vector<typename Arith::Elem> &G, const FixedBaseTable &tb, const Arith &ar)
+{
+    int rows = 1 << tb.h;
+    G.assign((size_t)tb.v * rows, typename Arith::Elem());
+
+    // base[i] = x^(2^(i*a))
+    vector<typename Arith::Elem> base(tb.h);
+    ar.enter(base[0], tb.x);
+    for (int i = 1; i < tb.h; ++i)
+    {
+        base[i] = base[i - 1];
+        for (int j = 0; j < tb.a; ++j)
+            ar.mul(base[i], base[i], base[i]);
+    }
+
+    // khối s: base[i] = x^(2^(i*a + s*b)), G[s][j] = G[s][j bỏ bit thấp] * base[bit thấp của j].
+    // Sang khối sau chỉ bình phương h phần tử base b lần (h*b bình phương), không phải cả 2^h phần tử của khối.
+    for (int s = 0; s < tb.v; ++s)
+    {
+        if (s > 0)
+            for (int i = 0; i < tb.h; ++i)
+                for (int c = 0; c < tb.b; ++c)
+                    ar.mul(base[i], base[i], base[i]);
+
+        typename Arith::Elem *Gs = &G[(size_t)s * rows];
+        ar.one(Gs[0]);
+        for (int j = 1; j < rows; ++j)
+        {
+            int low = __builtin_ctz(j);
+            if ((j & (j - 1)) == 0)
+                Gs[j] = base[low];
+            else
+                ar.mul(Gs[j], Gs[j & (j - 1)], base[low]);
+        }
+    }
+}
+
+void comb_init(FixedBaseTable &tb, const BigInt &x, const MontgomeryCtx &ctx, int max_bits, int h = 6, int v = 2)
+{
+    tb.ctx = ctx;
+    tb.x = x;
+    tb.max_bits = max_bits;
+    tb.h = h;
+    tb.v = v;
+    tb.a = (max_bits + h - 1) / h;
+    tb.b = (tb.a + v - 1) / v;
+    tb.ifma = use_ifma(ctx);
+    if (tb.ifma)
+    {
+        tb.G.clear();
+        comb_build(tb.G52, tb, IfmaArith{tb.ctx});
+    }
+    else
+    {
+        tb.G52.clear();
+        comb_build(tb.G, tb, ScalarArith{tb.ctx});
+    }
+}
 
-    // Binary exponentiation from MSB to LSB
-    for (int i = LIMBS * 32 - 1; i >= 0; --i)
+template <class Arith>
+void comb_eval(BigInt &res, const vector<typename Arith::Elem> &G, const FixedBaseTable &tb, const BigInt &k, const Arith &ar)
+{
+    int rows = 1 << tb.h;
+    typename Arith::Elem result = G[0];
+    bool started = false;
+    for (int c = tb.b - 1; c >= 0; --c)
     {
-        mont_mul(result, result, result, ctx);
-        if ((k.v[i / 32] >> (i % 32)) & 1)
+        if (started)
+            ar.mul(result, result, result);
+        for (int s = tb.v - 1; s >= 0; --s)
         {
-            mont_mul(result, result, x1, ctx);
+            // cột c của khối s ở hàng i là bit i*a + s*b + c
+            int col = s * tb.b + c;
+            if (col >= tb.a)
+                continue;
+            int j = 0;
+            for (int i = tb.h - 1; i >= 0; --i)
+            {
+                int pos = i * tb.a + col;
+                j = (j << 1) | (pos < LIMBS * 32 ? (k.v[pos / 32] >> (pos % 32)) & 1 : 0);
+            }
+            if (!j)
+                continue;
+            if (started)
+                ar.mul(result, result, G[(size_t)s * rows + j]);
+            else
+            {
+                result = G[(size_t)s * rows + j];
+                started = true;
+            }
         }
     }
 
-    from_mont(res, result, ctx);
+    ar.leave(res, result);
+}
+
+// res = x^k mod N với x của bảng; k dài hơn max_bits thì quay về mont_pow
+// (bảng cửa sổ của mont_pow là thread_local nên nhánh này cũng an toàn khi chạy song song)
+void comb_pow(BigInt &res, const FixedBaseTable &tb, const BigInt &k)
+{
+    if (bit_length(k) > tb.max_bits)
+        mont_pow(res, tb.x, k, tb.ctx);
+    else if (tb.ifma)
+        comb_eval(res, tb.G52, tb, k, IfmaArith{tb.ctx});
+    else
+        comb_eval(res, tb.G, tb, k, ScalarArith{tb.ctx});
+}
+
+// Dựng ctx.ifma: N theo digit 52 bit, k0 và R^2 mod N với R = 2^(52 * digits)
+void ifma_init(MontgomeryCtx &ctx)
+{
+    IfmaCtx &c = ctx.ifma;
+    c.digits = ((ctx.n * 32 + 51) / 52 + 7) / 8 * 8;
+    to_radix52(c.N, ctx.N, c.digits);
+
+    uint64_t inv = ctx.N.v[0] | ((uint64_t)ctx.N.v[1] << 32); // Newton: mỗi vòng gấp đôi số bit đúng
+    uint64_t n0 = inv;
+    for (int i = 0; i < 6; ++i)
+        inv *= 2 - n0 * inv;
+    c.k0 = (0 - inv) & MASK52;
+
+    BigInt R = {};
+    R.v[0] = 1;
+    for (int i = 0; i < c.digits * 52 * 2; i++)
+    {
+        uint64_t carry = 0;
+        for (int j = 0; j < ctx.n; ++j)
+        {
+            uint64_t v = ((uint64_t)R.v[j] << 1) | carry;
+            R.v[j] = (uint32_t)v;
+            carry = v >> 32;
+        }
+        if (carry || geq(R, ctx.N, ctx.n))
+            sub_mod(R, ctx.N, ctx.n);
+    }
+    to_radix52(c.R2, R, c.digits);
 }
 
 void mont_init(MontgomeryCtx &ctx)
@@ -136,31 +845,54 @@ void mont_init(MontgomeryCtx &ctx)
     // n_inv = -N^{-1} mod 2^32
     ctx.n_inv = montgomery_inv32(ctx.N.v[0]);
 
+    // n = vị trí word khác 0 cao nhất của N + 1
+    ctx.n = LIMBS;
+    while (ctx.n > 1 && ctx.N.v[ctx.n - 1] == 0)
+        --ctx.n;
+
     // Tính R^2 mod N
     BigInt R2 = {};
     BigInt one = {};
     one.v[0] = 1;
 
-    // R2 = (1 << (64 * LIMBS)) mod N
+    // R2 = (1 << (64 * n)) mod N
     // => dùng repeated squaring hoặc shift mod
     BigInt R = {};
     R.v[0] = 1;
-    for (int i = 0; i < LIMBS * 32 * 2; i++)
+    for (int i = 0; i < ctx.n * 32 * 2; i++)
     {
-        // R = (R << 1) mod N
+        // R = (R << 1) mod N, bit tràn khỏi n word vẫn phải trừ N
         uint64_t carry = 0;
-        for (int j = 0; j < LIMBS; ++j)
+        for (int j = 0; j < ctx.n; ++j)
         {
             uint64_t v = ((uint64_t)R.v[j] << 1) | carry;
             R.v[j] = (uint32_t)v;
             carry = v >> 32;
         }
-        if (geq(R, ctx.N))
-            sub_mod(R, ctx.N);
+        if (carry || geq(R, ctx.N, ctx.n))
+            sub_mod(R, ctx.N, ctx.n);
     }
     ctx.R2 = R;
+
+    if (g_use_ifma && ctx.n >= IFMA_MIN_LIMBS)
+        ifma_init(ctx);
 }
 
+// ---- Cache MontgomeryCtx theo N (mont_cache.h: đọc không khóa, đếm hit/LRU theo thread) ----
+static MontCache<MontgomeryCtx> g_mont_cache;
+typedef MontCache<MontgomeryCtx>::Handle MontCtxHandle;
+
+// ctx dùng chung cho N (giữ Handle trong lúc dùng ctx)
+MontCtxHandle mont_ctx_cached(const BigInt &N)
+{
+    return g_mont_cache.get(N.v, LIMBS, [&](MontgomeryCtx &ctx)
+                            {
+        ctx.N = N;
+        mont_init(ctx); });
+}
+uint64_t mont_cache_hits() { return g_mont_cache.hits(); }
+uint64_t mont_cache_misses() { return g_mont_cache.miss_count(); }
+
 // Chuyển little-endian hex string -> BigInt
 static BigInt fromLittleEndianHex(const string &s_in)
 {
@@ -296,22 +1028,180 @@ string toBigIntDecimal(const BigInt &a)
     return res;
 }
 
-int main()
+// bai3_fixed comb [h] [v]: cùng N, x của input.inp, so mont_pow với comb_pow trên các k ngẫu nhiên cỡ N
+void run_comb_bench(const BigInt &x, const MontgomeryCtx &ctx, int h, int v)
+{
+    int bits = ctx.n * 32;
+    mt19937 rng(12345);
+    const int reps = 200;
+    vector<BigInt> ks(reps);
+    for (auto &k : ks)
+        for (int i = 0; i < ctx.n; ++i)
+            k.v[i] = rng();
+
+    auto t0 = chrono::steady_clock::now();
+    FixedBaseTable tb;
+    comb_init(tb, x, ctx, bits, h, v);
+    auto t1 = chrono::steady_clock::now();
+
+    vector<BigInt> ref(reps), got(reps);
+    for (int i = 0; i < reps; ++i)
+        mont_pow(ref[i], x, ks[i], ctx);
+    auto t2 = chrono::steady_clock::now();
+    for (int i = 0; i < reps; ++i)
+        comb_pow(got[i], tb, ks[i]);
+    auto t3 = chrono::steady_clock::now();
+
+    int bad = 0;
+    for (int i = 0; i < reps; ++i)
+        bad += memcmp(ref[i].v, got[i].v, sizeof(ref[i].v)) != 0;
+
+    auto ms = [](chrono::steady_clock::duration d)
+    { return chrono::duration<double, milli>(d).count(); };
+    cout << "bits=" << bits << " h=" << h << " v=" << v << " table="
+         << (tb.ifma ? tb.G52.size() * sizeof(Ifma52) : tb.G.size() * sizeof(BigInt)) / 1024 << "KB"
+         << " init=" << ms(t1 - t0) << "ms\n";
+    cout << "mont_pow " << ms(t2 - t1) / reps << "ms/op, comb_pow " << ms(t3 - t2) / reps << "ms/op, mismatch " << bad << "\n";
+}
+
+// bai3_fixed ifma-check: so kernel IFMA với kernel 32 bit trên N ngẫu nhiên (a*b mod N, mont_pow, multi_modexp, comb_pow),
+// kèm thời gian
+int run_ifma_check()
+{
+    if (!g_use_ifma)
+    {
+        cout << "CPU không hỗ trợ AVX-512 IFMA\n";
+        return 0;
+    }
+    mt19937 rng(2024);
+    int bad = 0;
+    for (int n = IFMA_MIN_LIMBS; n <= LIMBS; n += 8)
+    {
+        MontgomeryCtx ctx;
+        for (int i = 0; i < n; ++i)
+            ctx.N.v[i] = rng();
+        ctx.N.v[0] |= 1;
+        ctx.N.v[n - 1] |= 1u << 31;
+        mont_init(ctx);
+        const IfmaCtx &c = ctx.ifma;
+
+        // (a*b*R^-1)*R^2*R^-1 = a*b mod N ở cả hai biểu diễn
+        for (int t = 0; t < 2000; ++t)
+        {
+            BigInt a, b, ref, got, tmp;
+            for (int i = 0; i < n; ++i)
+            {
+                a.v[i] = rng();
+                b.v[i] = rng();
+            }
+            if (t == 0)
+                for (int i = 0; i < n; ++i)
+                    a.v[i] = b.v[i] = ctx.N.v[i] - (i == 0); // N - 1
+            reduce_wide(a, a, ctx);
+            reduce_wide(b, b, ctx);
+            mont_mul(tmp, a, b, ctx);
+            mont_mul(ref, tmp, ctx.R2, ctx);
+            if (geq(ref, ctx.N, ctx.n))
+                sub_mod(ref, ctx.N, ctx.n);
+
+            alignas(64) uint64_t a52[IFMA_MAX_DIGITS], b52[IFMA_MAX_DIGITS], r52[IFMA_MAX_DIGITS];
+            to_radix52(a52, a, c.digits);
+            to_radix52(b52, b, c.digits);
+            ifma_mul(r52, a52, b52, c);
+            ifma_mul(r52, r52, c.R2, c);
+            from_radix52(got, r52, c.digits);
+            bad += memcmp(ref.v, got.v, sizeof(ref.v)) != 0;
+        }
+
+        // mont_pow, multi_modexp (2 số hạng) và comb_pow: cùng input, kernel 32 bit rồi IFMA
+        BigInt x[2], k[2];
+        for (int t = 0; t < 2; ++t)
+            for (int i = 0; i < n; ++i)
+            {
+                x[t].v[i] = rng();
+                k[t].v[i] = rng();
+            }
+        vector<BigInt> xs(x, x + 2), ks(k, k + 2);
+        auto ms = [](chrono::steady_clock::duration d)
+        { return chrono::duration<double, milli>(d).count() / 20; };
+        auto compare = [&](const char *name, const function<void(BigInt &)> &run)
+        {
+            BigInt ref, got;
+            double tm[2];
+            for (int use = 0; use < 2; ++use)
+            {
+                g_use_ifma = use;
+                auto t0 = chrono::steady_clock::now();
+                for (int r = 0; r < 20; ++r)
+                    run(use ? got : ref);
+                tm[use] = ms(chrono::steady_clock::now() - t0);
+            }
+            bad += memcmp(ref.v, got.v, sizeof(ref.v)) != 0;
+            cout << n * 32 << " bit " << name << ": scalar " << tm[0] << "ms, ifma " << tm[1] << "ms\n";
+        };
+        compare("mont_pow", [&](BigInt &r)
+                { mont_pow(r, x[0], k[0], ctx); });
+        compare("multi_modexp x2", [&](BigInt &r)
+                { multi_modexp(r, xs, ks, ctx); });
+        // để so: hai lần mont_pow rồi nhân lại (a*b*R^-1 * R^2 * R^-1 = a*b)
+        compare("mont_pow x2", [&](BigInt &r)
+                {
+                    BigInt p0, p1, t;
+                    mont_pow(p0, x[0], k[0], ctx);
+                    mont_pow(p1, x[1], k[1], ctx);
+                    mont_mul(t, p0, p1, ctx);
+                    mont_mul(r, t, ctx.R2, ctx);
+                    if (geq(r, ctx.N, ctx.n))
+                        sub_mod(r, ctx.N, ctx.n); });
+        // comb_init chọn kernel theo g_use_ifma: dựng sẵn một bảng cho mỗi kernel
+        FixedBaseTable tb[2];
+        for (int use = 0; use < 2; ++use)
+        {
+            g_use_ifma = use;
+            comb_init(tb[use], x[0], ctx, n * 32);
+        }
+        compare("comb_pow", [&](BigInt &r)
+                { comb_pow(r, tb[g_use_ifma], k[0]); });
+    }
+    cout << "mismatch " << bad << "\n";
+    return bad != 0;
+}
+
+int main(int argc, char *argv[])
 {
+    if (argc >= 2 && string(argv[1]) == "ifma-check")
+        return run_ifma_check();
+
     ios::sync_with_stdio(false);
     cin.tie(nullptr);
 
     string N_hex, k_hex, x_hex;
     // cin >> N_hex >> k_hex >> x_hex;
 
-    // read input from file
+    // read input from file; các cặp (k, x) thêm sau -> y = x^k * x2^k2 * ... mod N
     ifstream infile("input.inp");
     infile >> N_hex >> k_hex >> x_hex;
+    vector<string> extra;
+    string token;
+    while (infile >> token)
+        extra.push_back(token);
     infile.close();
 
 
     // Use fromLittleEndianHex for N and x, but maybe k needs different handling?
     BigInt N = fromLittleEndianHex(N_hex);
+    if (bit_length(N) == 0)
+    {
+        cerr << "N = 0\n";
+        return 1;
+    }
+    // Montgomery cần modulo lẻ: N = 2^s * m, lũy thừa mod m rồi ghép với phần mod 2^s (crt_even)
+    int s = 0;
+    while (!((N.v[s / 32] >> (s % 32)) & 1))
+        ++s;
+    BigInt m;
+    shift_right(m, N, s);
+    bool odd_part = bit_length(m) > 1;
     // Try parsing k with just first digit if it's odd length
     BigInt k;
     if (k_hex.length() == 2)
@@ -326,12 +1216,50 @@ int main()
     }
     BigInt x = fromLittleEndianHex(x_hex);
 
-    MontgomeryCtx ctx;
-    ctx.N = N;
-    mont_init(ctx);
+    MontCtxHandle cached;
+    if (odd_part)
+        cached = mont_ctx_cached(m);
+
+    if (argc >= 2 && string(argv[1]) == "comb")
+    {
+        // N chẵn: đo trên phần lẻ m
+        if (!odd_part)
+        {
+            cerr << "N = 2^s: không có phần lẻ để đo comb\n";
+            return 1;
+        }
+        run_comb_bench(x, cached->ctx, argc >= 3 ? atoi(argv[2]) : 6, argc >= 4 ? atoi(argv[3]) : 2);
+        return 0;
+    }
+
+    vector<BigInt> xs = {x}, ks = {k};
+    for (size_t i = 0; i + 1 < extra.size(); i += 2)
+    {
+        ks.push_back(fromLittleEndianHex(extra[i]));
+        xs.push_back(fromLittleEndianHex(extra[i + 1]));
+    }
 
     BigInt y;
-    mont_pow_simple(y, x, k, ctx);
+    if (odd_part)
+    {
+        if (xs.size() > 1)
+            multi_modexp(y, xs, ks, cached->ctx);
+        else
+            mont_pow(y, x, k, cached->ctx);
+    }
+    if (s > 0)
+    {
+        BigInt y2 = {};
+        y2.v[0] = 1;
+        for (size_t t = 0; t < xs.size(); ++t)
+        {
+            BigInt p;
+            pow_mod2k(p, xs[t], ks[t], s);
+            mul_low(y2, y2, p, (s + 31) / 32);
+        }
+        mask_bits(y2, s);
+        crt_even(y, y, y2, m, s);
+    }
 
     cout << toLittleEndianHex(y) << "\n";
 }
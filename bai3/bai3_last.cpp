@@ -1,4 +1,5 @@
 #include <bits/stdc++.h>
+#include "mont_cache.h"
 using namespace std;
 
 struct BigInt {
@@ -98,10 +99,10 @@ uint32_t montgomery_inv32(uint32_t n) {
     return ~x +1;
 }
 
-// Montgomery multiplication
+// Montgomery multiplication: a, b < N, đúng N.size() limb; mọi nhớ được lan truyền (T[2n] có thể khác 0)
 BigInt mont_mul(const BigInt &a, const BigInt &b, const MontgomeryCtx &ctx) {
-    int limbs = (int)a.size();
-    vector<uint64_t> T(limbs*2+2,0);
+    int limbs = ctx.N.size();
+    vector<uint32_t> T(limbs*2+1,0);
 
     for (int i=0;i<limbs;++i) {
         uint64_t carry=0;
@@ -110,24 +111,28 @@ BigInt mont_mul(const BigInt &a, const BigInt &b, const MontgomeryCtx &ctx) {
             T[i+j] = (uint32_t)prod;
             carry = prod >>32;
         }
-        T[i+limbs] += carry;
+        T[i+limbs] = (uint32_t)carry;
     }
 
     for (int i=0;i<limbs;++i) {
-        uint32_t m = (uint32_t)(T[i]*ctx.n_inv);
+        uint32_t m = T[i]*ctx.n_inv;
         uint64_t carry=0;
         for (int j=0;j<limbs;++j){
             uint64_t prod = (uint64_t)m*ctx.N.v[j]+T[i+j]+carry;
             T[i+j] = (uint32_t)prod;
             carry = prod >>32;
         }
-        T[i+limbs] += carry;
+        for (int k=i+limbs; carry; ++k) {
+            uint64_t sum = (uint64_t)T[k]+carry;
+            T[k] = (uint32_t)sum;
+            carry = sum>>32;
+        }
     }
 
     BigInt res(limbs);
-    for (int i=0;i<limbs;++i) res.v[i]=(uint32_t)T[i+limbs];
+    for (int i=0;i<limbs;++i) res.v[i]=T[i+limbs];
 
-    if (geq(res, ctx.N)) sub_mod(res, ctx.N);
+    if (T[2*limbs] || geq(res, ctx.N)) sub_mod(res, ctx.N);
     return res;
 }
 
@@ -170,12 +175,127 @@ MontgomeryCtx mont_init(const BigInt &N) {
             R2.v[j]=(uint32_t)tmp;
             carry=tmp>>32;
         }
-        if (geq(R2,N)) sub_mod(R2,N);
+        if (carry || geq(R2,N)) sub_mod(R2,N);
     }
     ctx.R2 = R2;
     return ctx;
 }
 
+// N chẵn: N = 2^s * m, Montgomery chạy trên m lẻ; mod 2^s chỉ cần nhân cắt cụt, m^-1 mod 2^s bằng Hensel,
+// ghép CRT: y = y1 + m * ((y2 - y1) * m^-1 mod 2^s). Không cần phép chia.
+
+// a * b mod 2^(32*words)
+BigInt mul_low(const BigInt &a, const BigInt &b, int words) {
+    BigInt r(words);
+    for (int i=0;i<words && i<a.size();++i) {
+        uint64_t carry=0;
+        for (int j=0;i+j<words;++j) {
+            uint64_t cur = (uint64_t)r.v[i+j] + (uint64_t)a.v[i]*(j<b.size()?b.v[j]:0) + carry;
+            r.v[i+j] = (uint32_t)cur;
+            carry = cur>>32;
+        }
+    }
+    return r;
+}
+
+// giữ s bit thấp (ceil(s/32) word)
+void mask_bits(BigInt &a, int s) {
+    a.v.resize((s+31)/32, 0);
+    if (s%32) a.v.back() &= (1u<<(s%32))-1;
+}
+
+BigInt shift_right(const BigInt &a, int s) {
+    int q = s/32, b = s%32;
+    BigInt r(max(1, a.size()-q));
+    for (int i=0;i+q<a.size();++i) {
+        uint64_t w = a.v[i+q];
+        if (i+q+1 < a.size()) w |= (uint64_t)a.v[i+q+1]<<32;
+        r.v[i] = (uint32_t)(w>>b);
+    }
+    while (r.size()>1 && r.v.back()==0) r.v.pop_back();
+    return r;
+}
+
+// x mod m (dịch từng bit), kết quả đúng m.size() limb như mont_mul cần
+BigInt reduce_mod(const BigInt &x, const BigInt &m) {
+    BigInt acc(m.size());
+    for (int i=x.size()*32-1;i>=0;--i) {
+        uint64_t carry = (x.v[i/32]>>(i%32))&1;
+        for (int j=0;j<acc.size();++j) {
+            uint64_t t = ((uint64_t)acc.v[j]<<1)|carry;
+            acc.v[j]=(uint32_t)t;
+            carry=t>>32;
+        }
+        if (carry || geq(acc,m)) sub_mod(acc,m);
+    }
+    return acc;
+}
+
+// x^k mod 2^s, nhị phân như mont_pow
+BigInt pow_mod2k(const BigInt &x, const BigInt &k, int s) {
+    int words = (s+31)/32;
+    BigInt xs = x;
+    mask_bits(xs, s);
+    BigInt r(words);
+    r.v[0] = 1;
+    for (int i=k.size()*32-1;i>=0;--i) {
+        r = mul_low(r,r,words);
+        if ((k.v[i/32]>>(i%32))&1) r = mul_low(r,xs,words);
+    }
+    mask_bits(r, s);
+    return r;
+}
+
+// m^-1 mod 2^(32*words) với m lẻ: Newton, mỗi vòng gấp đôi số bit đúng bắt đầu từ 32
+BigInt inverse_mod2k(const BigInt &m, int words) {
+    BigInt inv(words);
+    inv.v[0] = 0u - montgomery_inv32(m.v[0]);
+    for (int bits=32; bits<32*words; bits*=2) {
+        BigInt t = mul_low(m, inv, words);
+        uint64_t borrow = 0;
+        for (int i=0;i<words;++i) {
+            uint64_t diff = (uint64_t)(i==0?2:0) - t.v[i] - borrow;
+            t.v[i] = (uint32_t)diff;
+            borrow = diff>>63;
+        }
+        inv = mul_low(inv, t, words);
+    }
+    return inv;
+}
+
+// y1 = y mod m, y2 = y mod 2^s -> y mod 2^s * m (limbs word)
+BigInt crt_even(const BigInt &y1, const BigInt &y2, const BigInt &m, int s, int limbs) {
+    int words = (s+31)/32;
+    BigInt diff(words);
+    uint64_t borrow = 0;
+    for (int i=0;i<words;++i) {
+        uint64_t d = (uint64_t)y2.v[i] - (i<y1.size()?y1.v[i]:0) - borrow;
+        diff.v[i] = (uint32_t)d;
+        borrow = d>>63;
+    }
+    BigInt h = mul_low(diff, inverse_mod2k(m, words), words);
+    mask_bits(h, s);
+    BigInt y = mul_low(m, h, limbs);
+    uint64_t carry = 0;
+    for (int i=0;i<limbs;++i) {
+        uint64_t sum = (uint64_t)y.v[i] + (i<y1.size()?y1.v[i]:0) + carry;
+        y.v[i] = (uint32_t)sum;
+        carry = sum>>32;
+    }
+    return y;
+}
+
+// Cache MontgomeryCtx theo N (mont_cache.h: đọc không khóa, đếm hit/LRU theo thread)
+static MontCache<MontgomeryCtx> g_mont_cache;
+typedef MontCache<MontgomeryCtx>::Handle MontCtxHandle;
+
+// ctx dùng chung cho N (giữ Handle trong lúc dùng ctx)
+MontCtxHandle mont_ctx_cached(const BigInt &N) {
+    return g_mont_cache.get(N.v.data(), N.size(), [&](MontgomeryCtx &ctx) { ctx = mont_init(N); });
+}
+uint64_t mont_cache_hits() { return g_mont_cache.hits(); }
+uint64_t mont_cache_misses() { return g_mont_cache.miss_count(); }
+
 // Demo main
 int main(){
     ios::sync_with_stdio(false);
@@ -191,11 +311,20 @@ int main(){
     cout << "N has " << bitsN << " bits, using " << limbs << " limbs" << endl;
 
     BigInt N = fromLittleEndianHex(N_hex);
+    int s = 0;
+    while (s < N.size()*32 && !((N.v[s/32]>>(s%32))&1)) ++s;
+    if (s == N.size()*32) { cerr << "N = 0\n"; return 1; }
     BigInt k = fromLittleEndianHex(k_hex);
     BigInt x = fromLittleEndianHex(x_hex);
 
-    MontgomeryCtx ctx = mont_init(N);
-    BigInt y = mont_pow(x,k,ctx);
+    // Montgomery cần modulo lẻ: N = 2^s * m, lũy thừa mod m rồi ghép với phần mod 2^s
+    BigInt m = shift_right(N, s);
+    BigInt y(1);
+    if (m.size() > 1 || m.v[0] > 1) {
+        MontCtxHandle cached = mont_ctx_cached(m);
+        y = mont_pow(reduce_mod(x, m), k, cached->ctx);
+    }
+    if (s > 0) y = crt_even(y, pow_mod2k(x, k, s), m, s, N.size());
 
     cout << toLittleEndianHex(y) << "\n";
 }
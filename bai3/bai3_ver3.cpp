@@ -42,7 +42,7 @@ void sub_mod(BigInt &a, const BigInt &b) {
 
 // MontMul (a * b * R^-1 mod N)
 void mont_mul(BigInt &res, const BigInt &a, const BigInt &b, const MontgomeryCtx &ctx) {
-    uint64_t T[LIMBS * 2] = {0};
+    uint64_t T[LIMBS * 2 + 1] = {0};
 
     // t = a * b
     for (int i = 0; i < LIMBS; ++i) {
@@ -64,17 +64,20 @@ void mont_mul(BigInt &res, const BigInt &a, const BigInt &b, const MontgomeryCtx
             T[i + j] = (uint32_t)prod;
             carry = prod >> 32;
         }
-        uint64_t sum = T[i + LIMBS] + carry;
-        T[i + LIMBS] = (uint32_t)sum;
-        // phần cao hơn LIMBS+1 bỏ vì /R
+        // lan truyền nhớ lên các word cao (tối đa tới T[2*LIMBS])
+        for (int k = i + LIMBS; carry; ++k) {
+            uint64_t sum = T[k] + carry;
+            T[k] = (uint32_t)sum;
+            carry = sum >> 32;
+        }
     }
 
     // copy phần cao (T >> 32*LIMBS)
     for (int i = 0; i < LIMBS; ++i)
         res.v[i] = (uint32_t)T[i + LIMBS];
 
-    // nếu >= N thì trừ N
-    if (geq(res, ctx.N)) sub_mod(res, ctx.N);
+    // nếu tràn hoặc >= N thì trừ N
+    if (T[2 * LIMBS] || geq(res, ctx.N)) sub_mod(res, ctx.N);
 }
 
 // chuyển vào dạng Montgomery: a * R mod N
@@ -97,8 +100,10 @@ void mont_pow(BigInt &res, const BigInt &x, const BigInt &k, const MontgomeryCtx
     int table_size = 1 << w;
     vector<BigInt> table(table_size);
     table[1] = x1;
+    BigInt x2;
+    mont_mul(x2, x1, x1, ctx);
     for (int i = 3; i < table_size; i += 2)
-        mont_mul(table[i], table[i - 2], x1, ctx);
+        mont_mul(table[i], table[i - 2], x2, ctx);
 
     BigInt result;
     BigInt one = {};
@@ -113,7 +118,7 @@ void mont_pow(BigInt &res, const BigInt &x, const BigInt &k, const MontgomeryCtx
             int l = max(0, i - w + 1);
             while (((k.v[l / 32] >> (l % 32)) & 1) == 0) ++l;
             int win = 0;
-            for (int j = l; j <= i; ++j)
+            for (int j = i; j >= l; --j)
                 win = (win << 1) | ((k.v[j / 32] >> (j % 32)) & 1);
 
             for (int j = 0; j < i - l + 1; ++j)
@@ -127,6 +132,96 @@ void mont_pow(BigInt &res, const BigInt &x, const BigInt &k, const MontgomeryCtx
     from_mont(res, result, ctx);
 }
 
+// ---- N chẵn: N = 2^s * m ----
+// Montgomery chỉ chạy với m lẻ; mod 2^s chỉ cần nhân cắt cụt, m^-1 mod 2^s bằng Hensel,
+// ghép CRT: y = y1 + m * ((y2 - y1) * m^-1 mod 2^s). Không cần phép chia.
+
+// r = a * b mod 2^(32 * words)
+void mul_low(BigInt &r, const BigInt &a, const BigInt &b, int words) {
+    uint32_t t[LIMBS] = {0};
+    for (int i = 0; i < words; ++i) {
+        uint64_t carry = 0;
+        for (int j = 0; i + j < words; ++j) {
+            uint64_t cur = (uint64_t)t[i + j] + (uint64_t)a.v[i] * b.v[j] + carry;
+            t[i + j] = (uint32_t)cur;
+            carry = cur >> 32;
+        }
+    }
+    memcpy(r.v, t, sizeof(t));
+}
+
+// xóa mọi bit từ vị trí s trở lên
+void mask_bits(BigInt &v, int s) {
+    for (int i = 0; i < LIMBS; ++i) {
+        if (i * 32 >= s) v.v[i] = 0;
+        else if (i * 32 + 32 > s) v.v[i] &= (1u << (s % 32)) - 1;
+    }
+}
+
+void shift_right(BigInt &r, const BigInt &a, int s) {
+    BigInt t = {};
+    int q = s / 32, b = s % 32;
+    for (int i = 0; i + q < LIMBS; ++i) {
+        uint64_t w = a.v[i + q];
+        if (i + q + 1 < LIMBS) w |= (uint64_t)a.v[i + q + 1] << 32;
+        t.v[i] = (uint32_t)(w >> b);
+    }
+    r = t;
+}
+
+// res = x^k mod 2^s (nhị phân trên phép nhân cắt cụt)
+void pow_mod2k(BigInt &res, const BigInt &x, const BigInt &k, int s) {
+    int words = (s + 31) / 32;
+    BigInt xs = x;
+    mask_bits(xs, s);
+    BigInt r = {};
+    r.v[0] = 1;
+    for (int i = LIMBS * 32 - 1; i >= 0; --i) {
+        mul_low(r, r, r, words);
+        if ((k.v[i / 32] >> (i % 32)) & 1) mul_low(r, r, xs, words);
+    }
+    mask_bits(r, s);
+    res = r;
+}
+
+// inv = m^-1 mod 2^(32 * words) với m lẻ: Newton, mỗi vòng gấp đôi số bit đúng bắt đầu từ 32
+void inverse_mod2k(BigInt &inv, const BigInt &m, int words) {
+    inv = BigInt();
+    inv.v[0] = 0u - montgomery_inv32(m.v[0]);
+    for (int bits = 32; bits < 32 * words; bits *= 2) {
+        BigInt t;
+        mul_low(t, m, inv, words);
+        uint64_t borrow = 0;
+        for (int i = 0; i < words; ++i) {
+            uint64_t diff = (uint64_t)(i == 0 ? 2 : 0) - t.v[i] - borrow;
+            t.v[i] = (uint32_t)diff;
+            borrow = diff >> 63;
+        }
+        mul_low(inv, inv, t, words);
+    }
+}
+
+// y = y1 + m * ((y2 - y1) * m^-1 mod 2^s) với y1 = y mod m, y2 = y mod 2^s
+void crt_even(BigInt &y, const BigInt &y1, const BigInt &y2, const BigInt &m, int s) {
+    int words = (s + 31) / 32;
+    BigInt diff = y2, inv, h, mh;
+    uint64_t borrow = 0;
+    for (int i = 0; i < words; ++i) {
+        uint64_t d = (uint64_t)diff.v[i] - y1.v[i] - borrow;
+        diff.v[i] = (uint32_t)d;
+        borrow = d >> 63;
+    }
+    inverse_mod2k(inv, m, words);
+    mul_low(h, diff, inv, words);
+    mask_bits(h, s);
+    mul_low(mh, m, h, LIMBS); // m * h < N
+    uint64_t carry = 0;
+    for (int i = 0; i < LIMBS; ++i) {
+        uint64_t sum = (uint64_t)mh.v[i] + y1.v[i] + carry;
+        y.v[i] = (uint32_t)sum;
+        carry = sum >> 32;
+    }
+}
 
 void mont_init(MontgomeryCtx &ctx) {
     // n_inv = -N^{-1} mod 2^32
@@ -149,7 +244,7 @@ void mont_init(MontgomeryCtx &ctx) {
             R.v[j] = (uint32_t)v;
             carry = v >> 32;
         }
-        if (geq(R, ctx.N)) sub_mod(R, ctx.N);
+        if (carry || geq(R, ctx.N)) sub_mod(R, ctx.N);
     }
     ctx.R2 = R;
 }
@@ -271,6 +366,12 @@ int main() {
     cout << "x:" << fromLittleEndianToDec(x_hex) << "\n";
 
     BigInt N = fromHex(N_hex);
+    int s = 0;
+    while (s < LIMBS * 32 && !((N.v[s / 32] >> (s % 32)) & 1)) ++s;
+    if (s == LIMBS * 32) {
+        cerr << "N = 0\n";
+        return 1;
+    }
     BigInt k = fromHex(k_hex);
     BigInt x = fromHex(x_hex);
 
@@ -278,12 +379,22 @@ int main() {
     cout << "k: " << toHex(k) << "\n";
     cout << "x: " << toHex(x) << "\n";
 
-    MontgomeryCtx ctx;
-    ctx.N = N;
-    mont_init(ctx);
-
-    BigInt y;
-    mont_pow(y, x, k, ctx, 4); // cửa sổ kích thước 4
+    // Montgomery cần modulo lẻ: N = 2^s * m, lũy thừa mod m rồi ghép với phần mod 2^s
+    BigInt m, y;
+    shift_right(m, N, s);
+    BigInt one = {};
+    one.v[0] = 1;
+    if (memcmp(m.v, one.v, sizeof(m.v)) != 0) {
+        MontgomeryCtx ctx;
+        ctx.N = m;
+        mont_init(ctx);
+        mont_pow(y, x, k, ctx, 4); // cửa sổ kích thước 4
+    }
+    if (s > 0) {
+        BigInt y2;
+        pow_mod2k(y2, x, k, s);
+        crt_even(y, y, y2, m, s);
+    }
 
     cout << toHex(y) << "\n";
 }
\ No newline at end of file
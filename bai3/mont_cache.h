@@ -0,0 +1,293 @@
+// Cache ctx Montgomery theo N, dùng chung cho bai3_fixed.cpp và bai3_last.cpp.
+//
+// Đọc không khóa: SLOTS ô là con trỏ atomic tới entry bất biến. Thread đọc công bố con trỏ vào
+// hazard slot của riêng nó rồi đọc lại ô; còn khớp thì entry không bị giải phóng chừng nào Handle còn sống.
+// Miss mới khóa insert_lock: tính ctx, thay ô có lần dùng gần nhất cũ nhất (LRU gần đúng), entry bị thay
+// vào danh sách chờ và chỉ bị xóa khi không còn hazard nào trỏ tới.
+//
+// Bộ đếm hit và dấu LRU nằm trong record riêng của từng thread (chỉ thread chủ ghi), hit không ghi
+// vào cache line dùng chung. Dấu LRU là epoch, tăng mỗi lần miss; ô được dùng ở epoch e thì record
+// ghi used[ô] = e, lúc chọn ô để thay lấy max theo mọi thread.
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+template <class Ctx>
+class MontCache
+{
+public:
+    static const int SLOTS = 16;
+    static const int HAZARDS = 4; // số Handle một thread giữ cùng lúc
+
+    struct Entry
+    {
+        uint64_t hash;
+        std::vector<uint32_t> key; // N đã bỏ word 0 ở đầu cao
+        uint64_t installed;        // epoch lúc vào ô
+        Ctx ctx;
+    };
+
+private:
+    // Một record mỗi thread (dùng lại khi thread kết thúc), không bao giờ bị xóa trước cache
+    struct alignas(64) Record
+    {
+        std::atomic<const Entry *> hazard[HAZARDS];
+        std::atomic<uint64_t> used[SLOTS];
+        std::atomic<uint64_t> hits{0};
+        std::atomic<bool> owned{true};
+        Record *next = nullptr;
+
+        Record()
+        {
+            for (auto &h : hazard)
+                h.store(nullptr, std::memory_order_relaxed);
+            for (auto &u : used)
+                u.store(0, std::memory_order_relaxed);
+        }
+    };
+
+    // record của thread hiện tại cho từng cache; trả record khi thread kết thúc
+    struct ThreadRecords
+    {
+        std::vector<std::pair<const MontCache *, Record *>> items;
+        ~ThreadRecords()
+        {
+            for (auto &it : items)
+                it.second->owned.store(false, std::memory_order_release);
+        }
+    };
+
+public:
+    class Handle
+    {
+    public:
+        Handle() = default;
+        Handle(const Entry *e, std::atomic<const Entry *> *hz) : e_(e), hz_(hz) {}
+        Handle(Handle &&o) noexcept : e_(o.e_), hz_(o.hz_) { o.hz_ = nullptr; }
+        Handle &operator=(Handle &&o) noexcept
+        {
+            std::swap(e_, o.e_);
+            std::swap(hz_, o.hz_);
+            return *this;
+        }
+        Handle(const Handle &) = delete;
+        Handle &operator=(const Handle &) = delete;
+        ~Handle()
+        {
+            if (hz_)
+                hz_->store(nullptr, std::memory_order_release);
+        }
+
+        const Entry *operator->() const { return e_; }
+        const Entry &operator*() const { return *e_; }
+
+    private:
+        const Entry *e_ = nullptr;
+        std::atomic<const Entry *> *hz_ = nullptr;
+    };
+
+    MontCache()
+    {
+        for (auto &s : slots)
+            s.store(nullptr, std::memory_order_relaxed);
+    }
+
+    ~MontCache()
+    {
+        for (auto &s : slots)
+            delete s.load(std::memory_order_relaxed);
+        for (const Entry *e : retired)
+            delete e;
+        for (Record *r = records.load(std::memory_order_relaxed); r;)
+        {
+            Record *next = r->next;
+            delete r;
+            r = next;
+        }
+    }
+
+    // ctx cho N (n word thấp của words); init(Ctx &) chỉ được gọi khi miss
+    template <class Init>
+    Handle get(const uint32_t *words, int n, Init init)
+    {
+        while (n > 1 && words[n - 1] == 0)
+            --n;
+        uint64_t h = hash_of(words, n);
+        Record *me = my_record();
+
+        int hz = 0;
+        while (hz < HAZARDS && me->hazard[hz].load(std::memory_order_relaxed))
+            ++hz;
+        if (hz == HAZARDS)
+            throw std::runtime_error("MontCache: quá nhiều Handle trên một thread");
+
+        int slot = find(words, n, h, me->hazard[hz]);
+        if (slot >= 0)
+        {
+            me->hits.store(me->hits.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            touch(me, slot);
+            return Handle(me->hazard[hz].load(std::memory_order_relaxed), &me->hazard[hz]);
+        }
+
+        std::lock_guard<std::mutex> guard(insert_lock);
+        // thread khác có thể vừa chèn cùng N
+        if ((slot = find(words, n, h, me->hazard[hz])) >= 0)
+        {
+            me->hits.store(me->hits.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            touch(me, slot);
+            return Handle(me->hazard[hz].load(std::memory_order_relaxed), &me->hazard[hz]);
+        }
+        misses.store(misses.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+        uint64_t now = epoch.load(std::memory_order_relaxed) + 1;
+        epoch.store(now, std::memory_order_relaxed);
+        Entry *fresh = new Entry();
+        fresh->hash = h;
+        fresh->key.assign(words, words + n);
+        fresh->installed = now;
+        init(fresh->ctx);
+
+        int victim = pick_victim();
+        me->hazard[hz].store(fresh, std::memory_order_seq_cst);
+        const Entry *old = slots[victim].exchange(fresh, std::memory_order_seq_cst);
+        touch(me, victim);
+        if (old)
+            retired.push_back(old);
+        reclaim();
+        return Handle(fresh, &me->hazard[hz]);
+    }
+
+    uint64_t hits() const
+    {
+        uint64_t total = 0;
+        for (Record *r = records.load(std::memory_order_acquire); r; r = r->next)
+            total += r->hits.load(std::memory_order_relaxed);
+        return total;
+    }
+
+    uint64_t miss_count() const { return misses.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<const Entry *> slots[SLOTS];
+    std::atomic<Record *> records{nullptr};
+    std::atomic<uint64_t> epoch{0}, misses{0}; // chỉ ghi khi giữ insert_lock
+    std::mutex insert_lock;
+    std::vector<const Entry *> retired; // chỉ truy cập khi giữ insert_lock
+
+    static uint64_t hash_of(const uint32_t *words, int n)
+    {
+        uint64_t h = 1469598103934665603ULL; // FNV-1a
+        for (int i = 0; i < n; ++i)
+        {
+            h ^= words[i];
+            h *= 1099511628211ULL;
+        }
+        return h;
+    }
+
+    // ô chứa N, entry được công bố trong hz; -1 nếu không có (hz để trống)
+    int find(const uint32_t *words, int n, uint64_t h, std::atomic<const Entry *> &hz)
+    {
+        for (int i = 0; i < SLOTS; ++i)
+        {
+            const Entry *e = slots[i].load(std::memory_order_acquire);
+            if (!e)
+                continue;
+            hz.store(e, std::memory_order_seq_cst);
+            // ô đã đổi sau khi công bố: entry có thể đã bị thu hồi, không được đọc
+            if (slots[i].load(std::memory_order_seq_cst) != e)
+            {
+                hz.store(nullptr, std::memory_order_relaxed);
+                --i;
+                continue;
+            }
+            if (e->hash == h && (int)e->key.size() == n && memcmp(e->key.data(), words, n * sizeof(uint32_t)) == 0)
+                return i;
+        }
+        hz.store(nullptr, std::memory_order_release);
+        return -1;
+    }
+
+    void touch(Record *me, int slot)
+    {
+        me->used[slot].store(epoch.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+
+    // ô trống, hoặc ô có lần dùng gần nhất (theo mọi thread) cũ nhất
+    int pick_victim()
+    {
+        int victim = 0;
+        uint64_t oldest = UINT64_MAX;
+        for (int i = 0; i < SLOTS; ++i)
+        {
+            const Entry *e = slots[i].load(std::memory_order_relaxed);
+            if (!e)
+                return i;
+            uint64_t last = e->installed;
+            for (Record *r = records.load(std::memory_order_acquire); r; r = r->next)
+                last = std::max(last, r->used[i].load(std::memory_order_relaxed));
+            if (last < oldest)
+            {
+                victim = i;
+                oldest = last;
+            }
+        }
+        return victim;
+    }
+
+    // xóa các entry bị thay không còn hazard nào trỏ tới
+    void reclaim()
+    {
+        std::vector<const Entry *> keep;
+        for (const Entry *e : retired)
+        {
+            bool in_use = false;
+            for (Record *r = records.load(std::memory_order_acquire); r && !in_use; r = r->next)
+                for (auto &hz : r->hazard)
+                    if (hz.load(std::memory_order_seq_cst) == e)
+                    {
+                        in_use = true;
+                        break;
+                    }
+            if (in_use)
+                keep.push_back(e);
+            else
+                delete e;
+        }
+        retired.swap(keep);
+    }
+
+    Record *my_record()
+    {
+        thread_local ThreadRecords mine;
+        for (auto &it : mine.items)
+            if (it.first == this)
+                return it.second;
+
+        // dùng lại record của thread đã kết thúc, không có thì thêm record mới vào đầu danh sách
+        Record *r = records.load(std::memory_order_acquire);
+        for (; r; r = r->next)
+        {
+            bool expected = false;
+            if (!r->owned.load(std::memory_order_relaxed) &&
+                r->owned.compare_exchange_strong(expected, true, std::memory_order_acq_rel))
+                break;
+        }
+        if (!r)
+        {
+            r = new Record();
+            Record *head = records.load(std::memory_order_relaxed);
+            do
+                r->next = head;
+            while (!records.compare_exchange_weak(head, r, std::memory_order_release, std::memory_order_relaxed));
+        }
+        mine.items.push_back({this, r});
+        return r;
+    }
+};